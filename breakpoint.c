@@ -0,0 +1,530 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <ctype.h>
+
+#include "breakpoint.h"
+#include "mos6507.h"
+#include "mem.h"
+#include "expr.h"
+#include "main.h"
+
+
+
+#define BREAKPOINT_ADDRESS_SPACE 0x2000
+#define BREAKPOINT_BITMAP_SIZE (BREAKPOINT_ADDRESS_SPACE / 8)
+#define BREAKPOINT_LIST_MAX 16
+#define BREAKPOINT_MESSAGE_SIZE 80
+#define BREAKPOINT_COND_SIZE 64
+
+
+
+/* Execution breakpoints and watchpoints are bitmaps over the 8K address
+   space. Watchpoints work by putting wrappers around the TIA and PIA hooks,
+   which are only installed while a watchpoint is set, so nothing is paid
+   for them otherwise. Beam positions are kept as (scanline << 8) | dot.
+   Conditions are compiled once when set, and break when becoming true. */
+static mos6507_t *breakpoint_cpu = NULL;
+static mem_t *breakpoint_mem = NULL;
+static mem_read_hook_t  breakpoint_tia_read;
+static mem_write_hook_t breakpoint_tia_write;
+static mem_read_hook_t  breakpoint_pia_read;
+static mem_write_hook_t breakpoint_pia_write;
+
+static uint8_t breakpoint_exec_map[BREAKPOINT_BITMAP_SIZE];
+static uint8_t breakpoint_read_map[BREAKPOINT_BITMAP_SIZE];
+static uint8_t breakpoint_write_map[BREAKPOINT_BITMAP_SIZE];
+static int breakpoint_exec_count = 0;
+static int breakpoint_watch_count = 0;
+
+static uint32_t breakpoint_beam[BREAKPOINT_LIST_MAX];
+static int breakpoint_beam_count = 0;
+static uint32_t breakpoint_frame[BREAKPOINT_LIST_MAX];
+static int breakpoint_frame_count = 0;
+static expr_t breakpoint_cond[BREAKPOINT_LIST_MAX];
+static char breakpoint_cond_text[BREAKPOINT_LIST_MAX][BREAKPOINT_COND_SIZE];
+static bool breakpoint_cond_last[BREAKPOINT_LIST_MAX];
+static int breakpoint_cond_count = 0;
+
+static bool breakpoint_last_valid = false;
+static uint32_t breakpoint_beam_last;
+static uint32_t breakpoint_frame_last;
+
+static char breakpoint_msg[BREAKPOINT_MESSAGE_SIZE];
+static bool breakpoint_suspended = false;
+
+
+
+static bool breakpoint_bit(const uint8_t map[], uint16_t address)
+{
+  return (map[address >> 3] >> (address & 7)) & 1;
+}
+
+
+
+static bool breakpoint_bit_toggle(uint8_t map[], uint16_t address)
+{
+  map[address >> 3] ^= (1 << (address & 7));
+  return breakpoint_bit(map, address);
+}
+
+
+
+static uint16_t breakpoint_watch_address(uint16_t address, bool write)
+{
+  /* Fold the mirrors, so a watchpoint catches every alias. */
+  address &= 0x1FFF;
+  if ((address & 0x80) > 0) { /* PIA */
+    if ((address & 0x200) > 0) {
+      return address & 0x287;
+    }
+    return 0x80 | (address & 0x7F);
+  }
+  return address & (write ? 0x3F : 0x0F); /* TIA */
+}
+
+
+
+static void breakpoint_hit(const char *format, ...)
+{
+  va_list args;
+
+  /* Keep the first reason if several hit during the same instruction. */
+  if (breakpoint_msg[0] == '\0') {
+    va_start(args, format);
+    vsnprintf(breakpoint_msg, BREAKPOINT_MESSAGE_SIZE, format, args);
+    va_end(args);
+  }
+}
+
+
+
+static void breakpoint_watch(uint16_t address, uint8_t value, bool write)
+{
+  if (breakpoint_suspended) {
+    return;
+  }
+  if (breakpoint_bit(write ? breakpoint_write_map : breakpoint_read_map,
+    breakpoint_watch_address(address, write))) {
+    breakpoint_hit(write ? "Watchpoint: Write $%04x = $%02x\n" :
+                           "Watchpoint: Read $%04x = $%02x\n",
+      address, value);
+    debug(); /* Breaks when the instruction is done. */
+  }
+}
+
+
+
+static uint8_t breakpoint_tia_read_hook(void *tia, uint16_t address)
+{
+  uint8_t value = (breakpoint_tia_read)(tia, address);
+  breakpoint_watch(address, value, false);
+  return value;
+}
+
+
+
+static void breakpoint_tia_write_hook(void *tia, uint16_t address,
+  uint8_t value)
+{
+  breakpoint_watch(address, value, true);
+  (breakpoint_tia_write)(tia, address, value);
+}
+
+
+
+static uint8_t breakpoint_pia_read_hook(void *pia, uint16_t address)
+{
+  uint8_t value = (breakpoint_pia_read)(pia, address);
+  breakpoint_watch(address, value, false);
+  return value;
+}
+
+
+
+static void breakpoint_pia_write_hook(void *pia, uint16_t address,
+  uint8_t value)
+{
+  breakpoint_watch(address, value, true);
+  (breakpoint_pia_write)(pia, address, value);
+}
+
+
+
+static void breakpoint_hooks_install(void)
+{
+  if (breakpoint_watch_count > 0) {
+    breakpoint_mem->tia_read  = breakpoint_tia_read_hook;
+    breakpoint_mem->tia_write = breakpoint_tia_write_hook;
+    breakpoint_mem->pia_read  = breakpoint_pia_read_hook;
+    breakpoint_mem->pia_write = breakpoint_pia_write_hook;
+  } else {
+    breakpoint_mem->tia_read  = breakpoint_tia_read;
+    breakpoint_mem->tia_write = breakpoint_tia_write;
+    breakpoint_mem->pia_read  = breakpoint_pia_read;
+    breakpoint_mem->pia_write = breakpoint_pia_write;
+  }
+}
+
+
+
+static int breakpoint_list_toggle(uint32_t list[], int *count, uint32_t value)
+{
+  int i;
+
+  for (i = 0; i < *count; i++) {
+    if (list[i] == value) {
+      (*count)--;
+      list[i] = list[*count];
+      return 0;
+    }
+  }
+
+  if (*count >= BREAKPOINT_LIST_MAX) {
+    return -1;
+  }
+  list[*count] = value;
+  (*count)++;
+  return 1;
+}
+
+
+
+static int breakpoint_cond_toggle(const char *text)
+{
+  char trimmed[BREAKPOINT_COND_SIZE];
+  size_t len;
+  int i;
+
+  len = strlen(text);
+  while (len > 0 && isspace(text[len - 1])) {
+    len--;
+  }
+  if (len == 0 || len >= BREAKPOINT_COND_SIZE) {
+    return -1;
+  }
+  memcpy(trimmed, text, len);
+  trimmed[len] = '\0';
+
+  for (i = 0; i < breakpoint_cond_count; i++) {
+    if (strcmp(breakpoint_cond_text[i], trimmed) == 0) {
+      breakpoint_cond_count--;
+      breakpoint_cond[i] = breakpoint_cond[breakpoint_cond_count];
+      strcpy(breakpoint_cond_text[i],
+        breakpoint_cond_text[breakpoint_cond_count]);
+      breakpoint_cond_last[i] = breakpoint_cond_last[breakpoint_cond_count];
+      return 0;
+    }
+  }
+
+  if (breakpoint_cond_count >= BREAKPOINT_LIST_MAX) {
+    return -1;
+  }
+  if (expr_compile(&breakpoint_cond[breakpoint_cond_count], trimmed) != 0) {
+    return -1;
+  }
+  strcpy(breakpoint_cond_text[breakpoint_cond_count], trimmed);
+  /* Only break once it has been false, not if it already holds now. */
+  breakpoint_cond_last[breakpoint_cond_count] = true;
+  breakpoint_cond_count++;
+  return 1;
+}
+
+
+
+static int breakpoint_address(const char *args, unsigned int *address)
+{
+  if (*args == '$') {
+    args++;
+  }
+  if (sscanf(args, "%x", address) != 1) {
+    return -1;
+  }
+  return 0;
+}
+
+
+
+static void breakpoint_map_dump(FILE *fh, const char *name,
+  const uint8_t map[])
+{
+  int address;
+
+  for (address = 0; address < BREAKPOINT_ADDRESS_SPACE; address++) {
+    if (breakpoint_bit(map, address)) {
+      /* Show cartridge addresses in the usual $F000 mirror. */
+      fprintf(fh, "  %s $%04x\n", name,
+        (address & 0x1000) ? (address | 0xE000) : address);
+    }
+  }
+}
+
+
+
+static void breakpoint_dump(FILE *fh)
+{
+  int i;
+
+  breakpoint_map_dump(fh, "Execute", breakpoint_exec_map);
+  breakpoint_map_dump(fh, "Read   ", breakpoint_read_map);
+  breakpoint_map_dump(fh, "Write  ", breakpoint_write_map);
+  for (i = 0; i < breakpoint_beam_count; i++) {
+    fprintf(fh, "  Beam    %d,%d\n",
+      breakpoint_beam[i] >> 8, breakpoint_beam[i] & 0xFF);
+  }
+  for (i = 0; i < breakpoint_frame_count; i++) {
+    fprintf(fh, "  Frame   %u\n", breakpoint_frame[i]);
+  }
+  for (i = 0; i < breakpoint_cond_count; i++) {
+    fprintf(fh, "  Cond    %s\n", breakpoint_cond_text[i]);
+  }
+}
+
+
+
+static void breakpoint_clear(void)
+{
+  memset(breakpoint_exec_map, 0, BREAKPOINT_BITMAP_SIZE);
+  memset(breakpoint_read_map, 0, BREAKPOINT_BITMAP_SIZE);
+  memset(breakpoint_write_map, 0, BREAKPOINT_BITMAP_SIZE);
+  breakpoint_exec_count = 0;
+  breakpoint_watch_count = 0;
+  breakpoint_beam_count = 0;
+  breakpoint_frame_count = 0;
+  breakpoint_cond_count = 0;
+}
+
+
+
+void breakpoint_init(mos6507_t *cpu, mem_t *mem)
+{
+  /* Must be called after the TIA and PIA have installed their hooks. */
+  breakpoint_cpu = cpu;
+  breakpoint_mem = mem;
+  breakpoint_tia_read  = mem->tia_read;
+  breakpoint_tia_write = mem->tia_write;
+  breakpoint_pia_read  = mem->pia_read;
+  breakpoint_pia_write = mem->pia_write;
+
+  breakpoint_clear();
+  breakpoint_msg[0] = '\0';
+  breakpoint_last_valid = false;
+}
+
+
+
+int breakpoint_command(FILE *fh, const char *args)
+{
+  char kind;
+  unsigned int address;
+  int scanline, dot, result;
+  bool set;
+
+  while (isspace(*args)) {
+    args++;
+  }
+  kind = *args;
+  if (kind != '\0') {
+    args++;
+  }
+  while (isspace(*args)) {
+    args++;
+  }
+
+  switch (kind) {
+  case '\0':
+    breakpoint_dump(fh);
+    return 0;
+
+  case 'c':
+    breakpoint_clear();
+    break;
+
+  case 'x':
+    if (breakpoint_address(args, &address) != 0) {
+      return -1;
+    }
+    set = breakpoint_bit_toggle(breakpoint_exec_map, address & 0x1FFF);
+    breakpoint_exec_count += set ? 1 : -1;
+    fprintf(fh, "Breakpoint %s\n", set ? "set" : "cleared");
+    break;
+
+  case 'r':
+  case 'w':
+    if (breakpoint_address(args, &address) != 0) {
+      return -1;
+    }
+    if ((address & 0x1000) > 0) {
+      fprintf(fh, "Only RAM, TIA and PIA can be watched!\n");
+      return -1;
+    }
+    set = breakpoint_bit_toggle(
+      (kind == 'w') ? breakpoint_write_map : breakpoint_read_map,
+      breakpoint_watch_address(address, kind == 'w'));
+    breakpoint_watch_count += set ? 1 : -1;
+    fprintf(fh, "Watchpoint %s\n", set ? "set" : "cleared");
+    break;
+
+  case 'l':
+    dot = 0;
+    if (sscanf(args, "%d,%d", &scanline, &dot) < 1 ||
+      scanline < 0 || dot < 0 || dot > 0xFF) {
+      return -1;
+    }
+    result = breakpoint_list_toggle(breakpoint_beam, &breakpoint_beam_count,
+      (scanline << 8) | dot);
+    if (result < 0) {
+      fprintf(fh, "Too many beam breakpoints!\n");
+      return -1;
+    }
+    fprintf(fh, "Breakpoint %s\n", result ? "set" : "cleared");
+    break;
+
+  case 'f':
+    if (sscanf(args, "%u", &address) != 1) {
+      return -1;
+    }
+    result = breakpoint_list_toggle(breakpoint_frame,
+      &breakpoint_frame_count, address);
+    if (result < 0) {
+      fprintf(fh, "Too many frame breakpoints!\n");
+      return -1;
+    }
+    fprintf(fh, "Breakpoint %s\n", result ? "set" : "cleared");
+    break;
+
+  case '?':
+    result = breakpoint_cond_toggle(args);
+    if (result < 0) {
+      return -1;
+    }
+    fprintf(fh, "Condition %s\n", result ? "set" : "cleared");
+    break;
+
+  default:
+    return -1;
+  }
+
+  breakpoint_hooks_install();
+  breakpoint_last_valid = false; /* Beam only counts from here. */
+  return 0;
+}
+
+
+
+bool breakpoint_armed(void)
+{
+  return breakpoint_exec_count > 0 || breakpoint_watch_count > 0 ||
+         breakpoint_beam_count > 0 || breakpoint_frame_count > 0 ||
+         breakpoint_cond_count > 0;
+}
+
+
+
+bool breakpoint_check(bool fetch, uint32_t frame, int scanline, int dot)
+{
+  expr_env_t env;
+  uint32_t beam, target;
+  bool hit = false;
+  bool crossed;
+  int i;
+
+  /* Called after each step while armed, "fetch" is set if the CPU is not
+     halted and will run the instruction at PC next. */
+  if (fetch && breakpoint_exec_count > 0 &&
+    breakpoint_bit(breakpoint_exec_map, breakpoint_cpu->pc & 0x1FFF)) {
+    breakpoint_hit("Breakpoint: Execute $%04x\n", breakpoint_cpu->pc);
+    hit = true;
+  }
+
+  if (breakpoint_cond_count > 0) {
+    env.cpu      = breakpoint_cpu;
+    env.mem      = breakpoint_mem;
+    env.frame    = frame;
+    env.scanline = scanline;
+    env.dot      = dot;
+    for (i = 0; i < breakpoint_cond_count; i++) {
+      if (expr_eval(&breakpoint_cond[i], &env) != 0) {
+        if (! breakpoint_cond_last[i]) {
+          breakpoint_hit("Breakpoint: Condition %s\n", breakpoint_cond_text[i]);
+          hit = true;
+        }
+        breakpoint_cond_last[i] = true;
+      } else {
+        breakpoint_cond_last[i] = false;
+      }
+    }
+  }
+
+  /* The beam moves several dots per instruction, so look for a target
+     passed since last time, allowing for the wrap to a new frame. */
+  beam = (scanline << 8) | dot;
+  if (breakpoint_last_valid) {
+    for (i = 0; i < breakpoint_beam_count; i++) {
+      target = breakpoint_beam[i];
+      if (beam >= breakpoint_beam_last) {
+        crossed = target > breakpoint_beam_last && target <= beam;
+      } else {
+        crossed = target > breakpoint_beam_last || target <= beam;
+      }
+      if (crossed) {
+        breakpoint_hit("Breakpoint: Beam %u,%u\n", target >> 8, target & 0xFF);
+        hit = true;
+      }
+    }
+
+    if (frame != breakpoint_frame_last) {
+      for (i = 0; i < breakpoint_frame_count; i++) {
+        if (breakpoint_frame[i] == frame) {
+          breakpoint_hit("Breakpoint: Frame %u\n", frame);
+          hit = true;
+        }
+      }
+    }
+  }
+  breakpoint_beam_last = beam;
+  breakpoint_frame_last = frame;
+  breakpoint_last_valid = true;
+
+  return hit;
+}
+
+
+
+void breakpoint_restart(void)
+{
+  int i;
+
+  /* The machine state was replaced, so forget where the beam was. */
+  breakpoint_last_valid = false;
+  for (i = 0; i < breakpoint_cond_count; i++) {
+    breakpoint_cond_last[i] = true;
+  }
+}
+
+
+
+void breakpoint_message(FILE *fh)
+{
+  /* Also used with no file handle to just discard the message. */
+  if (breakpoint_msg[0] != '\0') {
+    if (fh != NULL) {
+      fprintf(fh, "%s", breakpoint_msg);
+    }
+    breakpoint_msg[0] = '\0';
+  }
+}
+
+
+
+void breakpoint_suspend(bool suspend)
+{
+  /* Used while running ahead, those accesses never really happen. */
+  breakpoint_suspended = suspend;
+}
+
+
+
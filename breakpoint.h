@@ -0,0 +1,18 @@
+#ifndef _BREAKPOINT_H
+#define _BREAKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "mos6507.h"
+#include "mem.h"
+
+void breakpoint_init(mos6507_t *cpu, mem_t *mem);
+int breakpoint_command(FILE *fh, const char *args);
+bool breakpoint_armed(void);
+bool breakpoint_check(bool fetch, uint32_t frame, int scanline, int dot);
+void breakpoint_restart(void);
+void breakpoint_message(FILE *fh);
+void breakpoint_suspend(bool suspend);
+
+#endif /* _BREAKPOINT_H */
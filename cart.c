@@ -1,128 +1,660 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "cart.h"
 #include "mem.h"
+#include "md5.h"
 #include "main.h"
 
 
 
-static char *cart_type(cart_type_t type)
+#define CART_HOTSPOT_NONE CART_WINDOW_SIZE
+
+
+#define CART_PEEK(cart, address) \
+  (cart)->page[(address) >> CART_PAGE_SHIFT][(address) & CART_PAGE_MASK]
+
+
+
+static void cart_map_rom(cart_t *cart, uint16_t address, uint16_t size,
+  uint32_t offset)
+{
+  int i;
+
+  offset %= cart->rom_size;
+  for (i = 0; i < size >> CART_PAGE_SHIFT; i++) {
+    cart->page[(address >> CART_PAGE_SHIFT) + i] =
+      &cart->rom[offset + (i << CART_PAGE_SHIFT)];
+    cart->page_write[(address >> CART_PAGE_SHIFT) + i] = NULL;
+  }
+}
+
+
+
+static void cart_map_ram(cart_t *cart, uint16_t address, uint16_t size,
+  uint16_t offset, bool write)
+{
+  int i;
+
+  /* Reading a write port gives the RAM contents, as there is nothing
+     better to give. */
+  for (i = 0; i < size >> CART_PAGE_SHIFT; i++) {
+    cart->page[(address >> CART_PAGE_SHIFT) + i] =
+      &cart->bank.ram[offset + (i << CART_PAGE_SHIFT)];
+    cart->page_write[(address >> CART_PAGE_SHIFT) + i] =
+      write ? &cart->bank.ram[offset + (i << CART_PAGE_SHIFT)] : NULL;
+  }
+}
+
+
+
+static void cart_map_2k(cart_t *cart)
+{
+  cart_map_rom(cart, 0x000, 0x800, 0);
+  cart_map_rom(cart, 0x800, 0x800, 0); /* Mirror */
+}
+
+
+
+static void cart_map_4k(cart_t *cart)
+{
+  cart_map_rom(cart, 0x000, 0x1000, 0);
+}
+
+
+
+/* F8, F6, F4 and FE: Whole 4K window switched. */
+static void cart_map_fx(cart_t *cart)
+{
+  cart_map_rom(cart, 0x000, 0x1000, cart->bank.select[0] * 0x1000);
+}
+
+static uint8_t cart_access_fx(cart_t *cart, uint16_t address)
+{
+  unsigned int bank = address - cart->mapper->hotspot;
+
+  if (bank < cart->rom_size / 0x1000) {
+    cart->bank.select[0] = bank;
+    cart_map(cart);
+  }
+  return CART_PEEK(cart, address);
+}
+
+
+
+/* SuperChip (F8SC, F6SC, F4SC) and CBS RAM+ (FA): RAM on top of the bank,
+   write port first and read port right after it. */
+static void cart_map_sc(cart_t *cart)
+{
+  uint16_t size = cart->mapper->ram_size;
+
+  cart_map_fx(cart);
+  cart_map_ram(cart, 0x000, size, 0, true);
+  cart_map_ram(cart, size, size, 0, false);
+}
+
+
+
+/* FE: The access after one to $01FE switches bank by bit 5 of the data,
+   which is the high byte of the address on JSR and RTS. */
+static void cart_fe_check(cart_t *cart, uint16_t address, uint8_t value)
+{
+  if (cart->bank.latch) {
+    cart->bank.select[0] = (value & 0x20) ? 0 : 1;
+    cart->bank.latch = false;
+    cart_map_fx(cart);
+    return;
+  }
+  cart->bank.latch = (address == 0x01FE);
+}
+
+static uint8_t cart_access_fe(cart_t *cart, uint16_t address)
+{
+  uint8_t value = CART_PEEK(cart, address); /* From the old bank. */
+
+  cart_fe_check(cart, 0x1000 | address, value);
+  return value;
+}
+
+static void cart_snoop_fe(void *cart, uint16_t address, uint8_t value)
+{
+  cart_fe_check((cart_t *)cart, address, value);
+}
+
+
+
+/* E0: Three 1K slices selectable, the last one fixed to the end. */
+static void cart_reset_e0(cart_t *cart)
 {
-  switch (type) {
-  case CART_TYPE_NONE:
-    return "Uninitialized";
-  case CART_TYPE_2K:
-    return "2K";
-  case CART_TYPE_4K:
-    return "4K";
-  case CART_TYPE_8K:
-    return "8K";
+  cart->bank.select[0] = 4;
+  cart->bank.select[1] = 5;
+  cart->bank.select[2] = 6;
+}
+
+static void cart_map_e0(cart_t *cart)
+{
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    cart_map_rom(cart, i * 0x400, 0x400, cart->bank.select[i] * 0x400);
+  }
+  cart_map_rom(cart, 0xC00, 0x400, 7 * 0x400);
+}
+
+static uint8_t cart_access_e0(cart_t *cart, uint16_t address)
+{
+  if (address < 0xFF8) {
+    cart->bank.select[(address - 0xFE0) >> 3] = address & 7;
+    cart_map_e0(cart);
+  }
+  return CART_PEEK(cart, address);
+}
+
+
+
+/* 3F: Writes to $00-$3F select the lower 2K, the upper 2K is fixed. */
+static void cart_map_3f(cart_t *cart)
+{
+  cart_map_rom(cart, 0x000, 0x800, cart->bank.select[0] * 0x800);
+  cart_map_rom(cart, 0x800, 0x800, cart->rom_size - 0x800);
+}
+
+static void cart_snoop_3f(void *cart, uint16_t address, uint8_t value)
+{
+  if (address < 0x40) {
+    ((cart_t *)cart)->bank.select[0] = value;
+    cart_map_3f((cart_t *)cart);
+  }
+}
+
+
+
+/* E7: Lower 2K is one of 7 ROM slices or 1K of RAM, then a 256 byte RAM
+   bank, and the rest is fixed to the last ROM slice. */
+static void cart_map_e7(cart_t *cart)
+{
+  uint16_t ram_bank;
+
+  if (cart->bank.select[0] == 7) {
+    cart_map_ram(cart, 0x000, 0x400, 0, true);
+    cart_map_ram(cart, 0x400, 0x400, 0, false);
+  } else {
+    cart_map_rom(cart, 0x000, 0x800, cart->bank.select[0] * 0x800);
+  }
+
+  ram_bank = 0x400 + (cart->bank.select[1] * 0x100);
+  cart_map_ram(cart, 0x800, 0x100, ram_bank, true);
+  cart_map_ram(cart, 0x900, 0x100, ram_bank, false);
+  cart_map_rom(cart, 0xA00, 0x600, (7 * 0x800) + 0x200);
+}
+
+static uint8_t cart_access_e7(cart_t *cart, uint16_t address)
+{
+  if (address <= 0xFE7) {
+    cart->bank.select[0] = address - 0xFE0;
+    cart_map_e7(cart);
+  } else if (address <= 0xFEB) {
+    cart->bank.select[1] = address - 0xFE8;
+    cart_map_e7(cart);
+  }
+  return CART_PEEK(cart, address);
+}
+
+
+
+static const cart_mapper_t cart_mappers[] = {
+  { CART_TYPE_NONE, "Uninitialized", 0, 0, CART_HOTSPOT_NONE,
+    NULL, cart_map_4k, NULL, NULL, NULL },
+  { CART_TYPE_2K, "2K", 0x800, 0, CART_HOTSPOT_NONE,
+    NULL, cart_map_2k, NULL, NULL, NULL },
+  { CART_TYPE_4K, "4K", 0x1000, 0, CART_HOTSPOT_NONE,
+    NULL, cart_map_4k, NULL, NULL, NULL },
+  { CART_TYPE_F8, "F8", 0x2000, 0, 0xFF8,
+    NULL, cart_map_fx, cart_access_fx, NULL, NULL },
+  { CART_TYPE_F6, "F6", 0x4000, 0, 0xFF6,
+    NULL, cart_map_fx, cart_access_fx, NULL, NULL },
+  { CART_TYPE_F4, "F4", 0x8000, 0, 0xFF4,
+    NULL, cart_map_fx, cart_access_fx, NULL, NULL },
+  { CART_TYPE_FE, "FE", 0x2000, 0, 0x000,
+    NULL, cart_map_fx, cart_access_fe, cart_snoop_fe, cart_snoop_fe },
+  { CART_TYPE_E0, "E0", 0x2000, 0, 0xFE0,
+    cart_reset_e0, cart_map_e0, cart_access_e0, NULL, NULL },
+  { CART_TYPE_3F, "3F", 0, 0, CART_HOTSPOT_NONE,
+    NULL, cart_map_3f, NULL, NULL, cart_snoop_3f },
+  { CART_TYPE_E7, "E7", 0x4000, 0x800, 0xFE0,
+    NULL, cart_map_e7, cart_access_e7, NULL, NULL },
+  { CART_TYPE_F8SC, "F8SC", 0x2000, 0x80, 0xFF8,
+    NULL, cart_map_sc, cart_access_fx, NULL, NULL },
+  { CART_TYPE_F6SC, "F6SC", 0x4000, 0x80, 0xFF6,
+    NULL, cart_map_sc, cart_access_fx, NULL, NULL },
+  { CART_TYPE_F4SC, "F4SC", 0x8000, 0x80, 0xFF4,
+    NULL, cart_map_sc, cart_access_fx, NULL, NULL },
+  { CART_TYPE_FA, "FA", 0x3000, 0x100, 0xFF8,
+    NULL, cart_map_sc, cart_access_fx, NULL, NULL },
+};
+
+#define CART_MAPPERS (sizeof(cart_mappers) / sizeof(cart_mapper_t))
+
+
+
+static const cart_mapper_t *cart_mapper_by_name(const char *name)
+{
+  unsigned int i;
+
+  for (i = 1; i < CART_MAPPERS; i++) {
+    if (strcasecmp(cart_mappers[i].name, name) == 0) {
+      return &cart_mappers[i];
+    }
+  }
+  return NULL;
+}
+
+
+
+static const char *cart_tv_names[] = {
+  "NTSC",
+  "PAL",
+  "SECAM",
+};
+
+static const char *cart_controller_names[] = {
+  "Joystick",
+  "Paddles",
+  "Keypad",
+  "Driving",
+};
+
+#define CART_TVS \
+  (sizeof(cart_tv_names) / sizeof(cart_tv_names[0]))
+#define CART_CONTROLLERS \
+  (sizeof(cart_controller_names) / sizeof(cart_controller_names[0]))
+
+
+
+static int cart_name_index(const char *names[], int count, const char *name)
+{
+  int i;
+
+  for (i = 0; i < count; i++) {
+    if (strcasecmp(names[i], name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+
+/* Database file, one cartridge per line, '#' starts a comment:
+   MD5 TYPE [TV [CONTROLLER [NAME]]]
+   Entries are only needed for images the heuristics get wrong, or that
+   are not NTSC or use other controllers than joysticks. Returns -1 if the
+   file cannot be read or the entry is invalid, 1 if found, else 0. */
+static int cart_db_lookup(cart_t *cart, const char *db,
+  const cart_mapper_t **mapper)
+{
+  FILE *fh;
+  char line[256];
+  char md5_text[CART_MD5_SIZE], type[8], tv[8], controller[16];
+  int fields, tv_index, controller_index, end;
+  int result = 0;
+
+  fh = fopen(db, "r");
+  if (fh == NULL) {
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), fh) != NULL) {
+    tv[0] = '\0';
+    controller[0] = '\0';
+    end = 0;
+    fields = sscanf(line, "%32s %7s %7s %15s %n",
+      md5_text, type, tv, controller, &end);
+    if (fields < 2 || md5_text[0] == '#' ||
+        strcasecmp(md5_text, cart->md5) != 0) {
+      continue;
+    }
+
+    tv_index = (fields > 2) ?
+      cart_name_index(cart_tv_names, CART_TVS, tv) : CART_TV_NTSC;
+    controller_index = (fields > 3) ?
+      cart_name_index(cart_controller_names, CART_CONTROLLERS, controller) :
+      CART_CONTROLLER_JOYSTICK;
+    *mapper = cart_mapper_by_name(type);
+    if (*mapper == NULL || tv_index < 0 || controller_index < 0) {
+      result = -1;
+      break;
+    }
+
+    cart->tv = tv_index;
+    cart->controller = controller_index;
+    if (fields > 3) {
+      line[strcspn(line, "\r\n")] = '\0';
+      snprintf(cart->name, CART_NAME_SIZE, "%s", &line[end]);
+    }
+    result = 1;
+    break;
+  }
+
+  fclose(fh);
+  return result;
+}
+
+
+
+/* Bank switching code leaves typical byte sequences, patterns are shared
+   with other emulators' detection. */
+static const uint8_t cart_sig_e0[][3] = {
+  {0x8D, 0xE0, 0x1F}, /* STA $1FE0 */
+  {0x8D, 0xE0, 0x5F}, /* STA $5FE0 */
+  {0x8D, 0xE9, 0xFF}, /* STA $FFE9 */
+  {0x0C, 0xE0, 0x1F}, /* NOP $1FE0 */
+  {0xAD, 0xE0, 0x1F}, /* LDA $1FE0 */
+  {0xAD, 0xE9, 0xFF}, /* LDA $FFE9 */
+  {0xAD, 0xED, 0xFF}, /* LDA $FFED */
+  {0xAD, 0xF3, 0xBF}, /* LDA $BFF3 */
+};
+
+static const uint8_t cart_sig_e7[][3] = {
+  {0xAD, 0xE2, 0xFF}, /* LDA $FFE2 */
+  {0xAD, 0xE5, 0xFF}, /* LDA $FFE5 */
+  {0xAD, 0xE5, 0x1F}, /* LDA $1FE5 */
+  {0xAD, 0xE7, 0x1F}, /* LDA $1FE7 */
+  {0x0C, 0xE7, 0x1F}, /* NOP $1FE7 */
+  {0x8D, 0xE7, 0xFF}, /* STA $FFE7 */
+  {0x8D, 0xE7, 0x1F}, /* STA $1FE7 */
+};
+
+static const uint8_t cart_sig_fe[][5] = {
+  {0x20, 0x00, 0xD0, 0xC6, 0xC5}, /* JSR $D000; DEC $C5 */
+  {0x20, 0xC3, 0xF8, 0xA5, 0x82}, /* JSR $F8C3; LDA $82 */
+  {0xD0, 0xFB, 0x20, 0x73, 0xFE}, /* BNE -5; JSR $FE73 */
+  {0x20, 0x00, 0xF0, 0x84, 0xD6}, /* JSR $F000; STY $D6 */
+};
+
+static const uint8_t cart_sig_3f[] = {0x85, 0x3F}; /* STA $3F */
+
+
+
+static int cart_count(const uint8_t *rom, uint32_t size,
+  const uint8_t *sig, int length, int max)
+{
+  uint32_t i;
+  int count = 0;
+
+  for (i = 0; i + length <= size && count < max; i++) {
+    if (rom[i] == sig[0] && memcmp(&rom[i], sig, length) == 0) {
+      count++;
+    }
+  }
+  return count;
+}
+
+
+
+#define CART_HAS_ANY(rom, size, sigs) \
+  cart_has_any(rom, size, &sigs[0][0], sizeof(sigs[0]), \
+    sizeof(sigs) / sizeof(sigs[0]))
+
+static bool cart_has_any(const uint8_t *rom, uint32_t size,
+  const uint8_t *sigs, int length, int count)
+{
+  int i;
+
+  for (i = 0; i < count; i++) {
+    if (cart_count(rom, size, &sigs[i * length], length, 1) > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+
+static bool cart_has_superchip(const uint8_t *rom, uint32_t size)
+{
+  uint32_t bank;
+
+  /* Images have the same filler in the write and read ports of every bank,
+     since that ROM area can never be seen. */
+  for (bank = 0; bank < size; bank += 0x1000) {
+    if (memcmp(&rom[bank], &rom[bank + 0x80], 0x80) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+
+static const cart_mapper_t *cart_detect(const uint8_t *rom, uint32_t size)
+{
+  bool tigervision;
+
+  tigervision = (cart_count(rom, size, cart_sig_3f,
+    sizeof(cart_sig_3f), 2) >= 2);
+
+  switch (size) {
+  case 0x800:
+    return &cart_mappers[CART_TYPE_2K];
+
+  case 0x1000:
+    return &cart_mappers[CART_TYPE_4K];
+
+  case 0x2000:
+    if (cart_has_superchip(rom, size)) {
+      return &cart_mappers[CART_TYPE_F8SC];
+    } else if (CART_HAS_ANY(rom, size, cart_sig_e0)) {
+      return &cart_mappers[CART_TYPE_E0];
+    } else if (tigervision) {
+      return &cart_mappers[CART_TYPE_3F];
+    } else if (CART_HAS_ANY(rom, size, cart_sig_fe)) {
+      return &cart_mappers[CART_TYPE_FE];
+    }
+    return &cart_mappers[CART_TYPE_F8];
+
+  case 0x3000:
+    return &cart_mappers[CART_TYPE_FA];
+
+  case 0x4000:
+    if (cart_has_superchip(rom, size)) {
+      return &cart_mappers[CART_TYPE_F6SC];
+    } else if (CART_HAS_ANY(rom, size, cart_sig_e7)) {
+      return &cart_mappers[CART_TYPE_E7];
+    } else if (tigervision) {
+      return &cart_mappers[CART_TYPE_3F];
+    }
+    return &cart_mappers[CART_TYPE_F6];
+
+  case 0x8000:
+    if (cart_has_superchip(rom, size)) {
+      return &cart_mappers[CART_TYPE_F4SC];
+    } else if (tigervision) {
+      return &cart_mappers[CART_TYPE_3F];
+    }
+    return &cart_mappers[CART_TYPE_F4];
+
   default:
-    return "???";
+    if (tigervision && size % 0x800 == 0) {
+      return &cart_mappers[CART_TYPE_3F];
+    }
+    return NULL;
   }
 }
 
 
 
+static uint8_t cart_peek_hook(void *cart, uint16_t address)
+{
+  /* What is mapped at the address now, without any hotspot effect. */
+  address &= 0xFFF; /* Mirroring */
+  return CART_PEEK((cart_t *)cart, address);
+}
+
+
+
 static uint8_t cart_read_hook(void *cart, uint16_t address)
 {
+  cart_t *c = (cart_t *)cart;
+
   address &= 0xFFF; /* Mirroring */
 
-  if (((cart_t *)cart)->type == CART_TYPE_8K) {
-    switch (address) {
-    case 0xFF8:
-      ((cart_t *)cart)->bank_select = 0;
-      break;
-    case 0xFF9:
-      ((cart_t *)cart)->bank_select = 1;
-      break;
-    }
+  /* Only the mapper's hotspot area needs a closer look, everything else
+     goes straight through the page table. */
+  if (address >= c->hotspot) {
+    return (c->mapper->access)(c, address);
   }
 
-  return ((cart_t *)cart)->bank[((cart_t *)cart)->bank_select][address];
+  return CART_PEEK(c, address);
 }
 
 
 
 static void cart_write_hook(void *cart, uint16_t address, uint8_t value)
 {
+  cart_t *c = (cart_t *)cart;
+  uint8_t *page;
+
   address &= 0xFFF; /* Mirroring */
-  (void)value;
 
-  if (((cart_t *)cart)->type == CART_TYPE_8K) {
-    switch (address) {
-    case 0xFF8:
-      ((cart_t *)cart)->bank_select = 0;
-      break;
-    case 0xFF9:
-      ((cart_t *)cart)->bank_select = 1;
-      break;
-    }
+  if (address >= c->hotspot) {
+    (c->mapper->access)(c, address);
+  }
+
+  page = c->page_write[address >> CART_PAGE_SHIFT];
+  if (page != NULL) {
+    page[address & CART_PAGE_MASK] = value;
   }
 }
 
 
 
+static void cart_set_mapper(cart_t *cart, const cart_mapper_t *mapper)
+{
+  cart->mapper = mapper;
+  cart->type = mapper->type;
+  cart->hotspot = mapper->hotspot;
+  memset(&cart->bank, 0, sizeof(cart_bank_t));
+  if (mapper->reset != NULL) {
+    (mapper->reset)(cart);
+  }
+  cart_map(cart);
+
+  cart->mem->cart_snoop_read  = mapper->snoop_read;
+  cart->mem->cart_snoop_write = mapper->snoop_write;
+}
+
+
+
 void cart_init(cart_t *cart, mem_t *mem)
 {
-  cart->type = CART_TYPE_NONE;
-  cart->bank_select = 0;
+  cart->mem = mem;
+  cart->rom_size = CART_WINDOW_SIZE;
+  cart->md5[0] = '\0';
+  cart->name[0] = '\0';
+  cart->tv = CART_TV_NTSC;
+  cart->controller = CART_CONTROLLER_JOYSTICK;
+  memset(cart->rom, 0, sizeof(cart->rom));
+  cart_set_mapper(cart, &cart_mappers[CART_TYPE_NONE]);
+
   mem->cart = cart;
   mem->cart_read  = cart_read_hook;
   mem->cart_write = cart_write_hook;
+  mem->cart_peek  = cart_peek_hook;
 }
 
 
 
-int cart_load(cart_t *cart, const char *filename)
+int cart_load(cart_t *cart, const char *filename, const char *type,
+  const char *db)
 {
-  FILE *fh;
-  int c, n, bank_no;
+  int fd, i;
+  struct stat st;
+  uint8_t digest[MD5_DIGEST_SIZE];
+  const cart_mapper_t *mapper;
 
-  fh = fopen(filename, "rb");
-  if (fh == NULL) {
+  fd = open(filename, O_RDONLY);
+  if (fd == -1) {
     return -1;
   }
 
-  cart->type = CART_TYPE_4K; /* Initially, if nothing else triggers. */
-  bank_no = 0;
-  n = 0;
-  while ((c = fgetc(fh)) != EOF) {
-    if (bank_no > 0) {
-      cart->type = CART_TYPE_8K; /* Simple check, if more than 4K. */
-    }
-    cart->bank[bank_no][n] = c;
-    n++;
-    if (n >= CART_BANK_SIZE) {
-      n = 0;
-      bank_no++;
-      if (bank_no >= CART_BANK_MAX) {
-        break;
-      }
-    }
+  /* The whole image in one read, it is at most 64K. */
+  if (fstat(fd, &st) == -1 || st.st_size <= 0 ||
+      st.st_size > CART_ROM_MAX ||
+      read(fd, cart->rom, st.st_size) != st.st_size) {
+    close(fd);
+    return -1;
   }
+  close(fd);
+  cart->rom_size = st.st_size;
 
-  /* Duplicate to upper area if 2K cartridge: */
-  while (bank_no == 0 && n < CART_BANK_SIZE) {
-    cart->type = CART_TYPE_2K; /* Simple check, if less than 4K. */
-    cart->bank[0][n] = cart->bank[0][n - 0x800];
-    n++;
+  md5(cart->rom, cart->rom_size, digest);
+  for (i = 0; i < MD5_DIGEST_SIZE; i++) {
+    snprintf(&cart->md5[i * 2], 3, "%02x", digest[i]);
   }
 
-  fclose(fh);
+  /* The database is checked first, but -b still picks the mapper. */
+  mapper = NULL;
+  cart->name[0] = '\0';
+  cart->tv = CART_TV_NTSC;
+  cart->controller = CART_CONTROLLER_JOYSTICK;
+  if (db != NULL && cart_db_lookup(cart, db, &mapper) < 0) {
+    return -1;
+  }
+  if (type != NULL) {
+    mapper = cart_mapper_by_name(type);
+  } else if (mapper == NULL) {
+    mapper = cart_detect(cart->rom, cart->rom_size);
+  }
+  if (mapper == NULL) {
+    return -1;
+  }
+
+  if (mapper->rom_size > 0) {
+    if (cart->rom_size != mapper->rom_size) {
+      return -1;
+    }
+  } else if (cart->rom_size % 0x800 != 0) {
+    return -1;
+  }
+
+  cart_set_mapper(cart, mapper);
   return 0;
 }
 
 
 
+void cart_map(cart_t *cart)
+{
+  (cart->mapper->map)(cart);
+}
+
+
+
 void cart_dump(FILE *fh, cart_t *cart)
 {
-  fprintf(fh, "Cartridge Type: %s\n", cart_type(cart->type));
-  fprintf(fh, "Bank Selected: %d\n", cart->bank_select);
+  int i;
+
+  fprintf(fh, "Cartridge Type: %s\n", cart->mapper->name);
+  if (cart->name[0] != '\0') {
+    fprintf(fh, "Cartridge Name: %s\n", cart->name);
+  }
+  fprintf(fh, "TV Standard: %s\n", cart_tv_names[cart->tv]);
+  fprintf(fh, "Controller: %s\n", cart_controller_names[cart->controller]);
+  fprintf(fh, "ROM Size: %uK\n", cart->rom_size / 1024);
+  fprintf(fh, "ROM MD5: %s\n", cart->md5);
+  fprintf(fh, "Bank Selected:");
+  for (i = 0; i < CART_SLOTS; i++) {
+    fprintf(fh, " %d", cart->bank.select[i]);
+  }
+  fprintf(fh, "\n");
 }
 
 
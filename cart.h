@@ -6,24 +6,92 @@
 #include <stdio.h>
 #include "mem.h"
 
-#define CART_BANK_SIZE 0x1000
-#define CART_BANK_MAX 2
+#define CART_WINDOW_SIZE 0x1000
+#define CART_ROM_MAX 0x10000
+#define CART_RAM_MAX 0x800
+#define CART_SLOTS 4 /* Bank registers, used as needed by the mapper. */
+#define CART_MD5_SIZE 33 /* Hex text of the ROM image MD5. */
+#define CART_NAME_SIZE 64
+
+/* The 4K window is split in pages small enough for the finest mapping,
+   which is the 128 byte SuperChip write and read ports. Cartridge RAM is
+   mapped by the same pages as ROM, so it costs nothing extra to access. */
+#define CART_PAGE_SHIFT 7
+#define CART_PAGE_SIZE (1 << CART_PAGE_SHIFT)
+#define CART_PAGE_MASK (CART_PAGE_SIZE - 1)
+#define CART_PAGES (CART_WINDOW_SIZE / CART_PAGE_SIZE)
 
 typedef enum cart_type_s {
   CART_TYPE_NONE,
   CART_TYPE_2K,
   CART_TYPE_4K,
-  CART_TYPE_8K,
+  CART_TYPE_F8,
+  CART_TYPE_F6,
+  CART_TYPE_F4,
+  CART_TYPE_FE,
+  CART_TYPE_E0,
+  CART_TYPE_3F,
+  CART_TYPE_E7,
+  CART_TYPE_F8SC,
+  CART_TYPE_F6SC,
+  CART_TYPE_F4SC,
+  CART_TYPE_FA,
 } cart_type_t;
 
+typedef enum cart_tv_s {
+  CART_TV_NTSC,
+  CART_TV_PAL,
+  CART_TV_SECAM,
+} cart_tv_t;
+
+typedef enum cart_controller_s {
+  CART_CONTROLLER_JOYSTICK,
+  CART_CONTROLLER_PADDLES,
+  CART_CONTROLLER_KEYPAD,
+  CART_CONTROLLER_DRIVING,
+} cart_controller_t;
+
+typedef struct cart_bank_s {
+  uint8_t select[CART_SLOTS];
+  bool latch; /* FE: Last access was to $01FE. */
+  uint8_t ram[CART_RAM_MAX];
+} cart_bank_t;
+
+struct cart_s;
+
+typedef struct cart_mapper_s {
+  cart_type_t type;
+  const char *name;
+  uint32_t rom_size; /* Expected size, or 0 for any multiple of 2K. */
+  uint16_t ram_size;
+  uint16_t hotspot; /* Accesses at or above this go through access. */
+  void (*reset)(struct cart_s *cart);
+  void (*map)(struct cart_s *cart);
+  uint8_t (*access)(struct cart_s *cart, uint16_t address);
+  mem_write_hook_t snoop_read; /* Bus activity outside the cartridge. */
+  mem_write_hook_t snoop_write;
+} cart_mapper_t;
+
 typedef struct cart_s {
   cart_type_t type;
-  uint8_t bank[CART_BANK_MAX][CART_BANK_SIZE];
-  int bank_select;
+  const cart_mapper_t *mapper;
+  mem_t *mem;
+  uint32_t rom_size;
+  char md5[CART_MD5_SIZE];
+  char name[CART_NAME_SIZE]; /* Empty if not in the database. */
+  cart_tv_t tv;
+  cart_controller_t controller;
+  uint16_t hotspot;
+  uint8_t *page[CART_PAGES];
+  uint8_t *page_write[CART_PAGES]; /* NULL if not RAM. */
+  cart_bank_t bank; /* All that changes while running. */
+  uint8_t rom[CART_ROM_MAX];
 } cart_t;
 
 void cart_init(cart_t *cart, mem_t *mem);
-int cart_load(cart_t *cart, const char *filename);
+int cart_load(cart_t *cart, const char *filename, const char *type,
+  const char *db);
+void cart_map(cart_t *cart);
 void cart_dump(FILE *fh, cart_t *cart);
 
 #endif /* _CART_H */
@@ -4,17 +4,63 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <curses.h>
+#include <unistd.h>
+#include <time.h>
 
 #include "console.h"
 #include "tia.h"
+#include "palette.h"
+
+#define CONSOLE_SCANLINES 228
+
+/* Worst case output per cell: cursor move, two truecolor escapes, glyph. */
+#define CONSOLE_ANSI_CELL_MAX 64
+#define CONSOLE_ANSI_UNKNOWN 0xFF
+
+/* Frame skipping when the terminal cannot keep up with the output. */
+#define CONSOLE_SKIP_MAX 30
+#define CONSOLE_DRAIN_BUDGET 8000 /* Microseconds */
+#define CONSOLE_STATUS_SIZE 48
+
+typedef struct console_cell_s {
+  uint8_t top;
+  uint8_t bottom;
+} console_cell_t;
 
 
 
 static bool console_active = false;
 static bool console_colors = false;
+static bool console_ansi = false;
 static int console_maxy;
 static int console_maxx;
 static bool console_vblank_strip = false;
+static int console_vblank_start = 0;
+static int console_vblank_end = CONSOLE_SCANLINES;
+
+/* Hash of each scanline as last drawn, to skip unchanged rows. */
+static uint32_t console_scanline_hash[CONSOLE_SCANLINES];
+static bool console_scanline_drawn[CONSOLE_SCANLINES];
+
+/* Mapping tables, rebuilt only when the terminal is resized. */
+static int console_scanline_row_map[CONSOLE_SCANLINES]; /* -1 if not seen. */
+static int *console_column_pos = NULL;
+static char *console_line = NULL;
+
+static int console_skip = 0; /* Frames skipped for each presented frame. */
+static int console_skip_remaining = 0;
+static bool console_skip_frame = false;
+static bool console_status_shown = false;
+static int console_fps_emulated = 0;
+static int console_fps_presented = 0;
+static int console_frames_emulated = 0;
+static int console_frames_presented = 0;
+static time_t console_fps_second = 0;
+
+/* Half-block cells for raw ANSI output, current and as shown on terminal. */
+static console_cell_t *console_cell = NULL;
+static console_cell_t *console_cell_shown = NULL;
+static char *console_ansi_buffer = NULL;
 
 static const uint16_t console_system_switches_map[5] =
   {0x1, 0x2, 0x8, 0x40, 0x80};
@@ -28,6 +74,13 @@ static bool console_joystick_button_p1 = true;
 
 
 
+/* Glyph for each TIA object type, unused entries are blank. */
+static const char console_object_glyph[TIA_OBJECT_HM + 1] = {
+  '1', '2', '%', '%', '*', ' ', ' ', ' ', ' ', ' ', '#', ' ', ' ', ' ',
+};
+
+
+
 /* Using colors from the default rxvt color palette. */
 static const int console_color_map[128] = {
   232,  58,  52,  88,  88,  89,  54,  18,
@@ -50,6 +103,111 @@ static const int console_color_map[128] = {
 
 
 
+static void console_invalidate(void)
+{
+  int i;
+
+  for (i = 0; i < CONSOLE_SCANLINES; i++) {
+    console_scanline_drawn[i] = false;
+  }
+
+  if (console_cell_shown != NULL) {
+    memset(console_cell_shown, CONSOLE_ANSI_UNKNOWN,
+      console_maxy * console_maxx * sizeof(console_cell_t));
+  }
+}
+
+
+
+static int console_ansi_alloc(void)
+{
+  size_t cells;
+
+  cells = console_maxy * console_maxx;
+  free(console_cell);
+  free(console_cell_shown);
+  free(console_ansi_buffer);
+  console_cell = calloc(cells, sizeof(console_cell_t));
+  console_cell_shown = calloc(cells, sizeof(console_cell_t));
+  console_ansi_buffer = malloc((cells * CONSOLE_ANSI_CELL_MAX) + 16);
+  if (console_cell == NULL || console_cell_shown == NULL ||
+      console_ansi_buffer == NULL) {
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+static int console_rows(void)
+{
+  /* Two scanlines per row with half-block characters. */
+  return console_ansi ? console_maxy * 2 : console_maxy;
+}
+
+
+
+static int console_scanline_row(int y)
+{
+  if (console_vblank_strip) {
+    /* Strip VBLANK from top/bottom to save precious console real estate. */
+    return (int)((y - console_vblank_start) /
+      ((console_vblank_end - console_vblank_start) / (float)console_rows()));
+  } else {
+    return (int)(y / (CONSOLE_SCANLINES / (float)console_rows()));
+  }
+}
+
+
+
+static void console_map_rows(void)
+{
+  int y;
+  int row;
+
+  for (y = 0; y < CONSOLE_SCANLINES; y++) {
+    row = console_scanline_row(y);
+    if (row < 0 || row >= console_rows()) {
+      row = -1;
+    }
+    console_scanline_row_map[y] = row;
+  }
+
+  /* Several scanlines may map to the same row, only the last one is seen. */
+  for (y = 0; y < CONSOLE_SCANLINES - 1; y++) {
+    if (console_scanline_row_map[y] == console_scanline_row_map[y + 1]) {
+      console_scanline_row_map[y] = -1;
+    }
+  }
+
+  console_invalidate();
+}
+
+
+
+static int console_map_build(void)
+{
+  int con_x;
+
+  free(console_column_pos);
+  free(console_line);
+  console_column_pos = malloc(console_maxx * sizeof(int));
+  console_line = malloc(console_maxx + 1);
+  if (console_column_pos == NULL || console_line == NULL) {
+    return -1;
+  }
+
+  for (con_x = 0; con_x < console_maxx; con_x++) {
+    console_column_pos[con_x] = (int)(con_x / (console_maxx / 160.0));
+  }
+
+  console_map_rows();
+  return 0;
+}
+
+
+
 void console_pause(void)
 {
   if (! console_active) {
@@ -70,6 +228,7 @@ void console_resume(void)
 
   timeout(0);
   refresh();
+  console_invalidate(); /* Screen contents lost with raw ANSI output. */
 }
 
 
@@ -82,12 +241,13 @@ void console_exit(void)
 
 
 
-void console_init(bool vblank_strip, bool disable_colors)
+int console_init(bool vblank_strip, bool disable_colors, bool ansi)
 {
   int i;
 
   console_active = true;
   console_vblank_strip = vblank_strip;
+  console_ansi = ansi;
 
   initscr();
   atexit(console_exit);
@@ -112,6 +272,15 @@ void console_init(bool vblank_strip, bool disable_colors)
       }
     }
   }
+
+  if (console_ansi) {
+    if (console_ansi_alloc() != 0) {
+      return -1;
+    }
+    refresh(); /* Let curses clear the screen before any frame is written. */
+  }
+
+  return console_map_build();
 }
 
 
@@ -119,6 +288,16 @@ void console_init(bool vblank_strip, bool disable_colors)
 static void console_winch(void)
 {
   getmaxyx(stdscr, console_maxy, console_maxx);
+  if (console_ansi) {
+    if (console_ansi_alloc() != 0) {
+      exit(EXIT_FAILURE);
+    }
+    clear(); /* Blank the terminal once, redrawn fully on next frame. */
+    refresh();
+  }
+  if (console_map_build() != 0) {
+    exit(EXIT_FAILURE);
+  }
   flushinp();
   keypad(stdscr, TRUE);
 }
@@ -153,7 +332,130 @@ bool console_get_joystick_button_p1(void)
 
 
 
-void console_update(void)
+static void console_ansi_present(const char *status)
+{
+  int y, x, i, len;
+  int next_y, next_x;
+  int fg, bg;
+  char *p;
+  ssize_t n;
+
+  p = console_ansi_buffer;
+  next_y = -1;
+  next_x = -1;
+  fg = -1;
+  bg = -1;
+
+  /* Emit only changed cells, where the top half is the foreground color
+     of the upper half block glyph and the bottom half is the background. */
+  for (y = 0; y < console_maxy; y++) {
+    for (x = 0; x < console_maxx; x++) {
+      i = (y * console_maxx) + x;
+      if (console_cell[i].top    == console_cell_shown[i].top &&
+          console_cell[i].bottom == console_cell_shown[i].bottom) {
+        continue;
+      }
+
+      if (y != next_y || x != next_x) {
+        p += sprintf(p, "\x1b[%d;%dH", y + 1, x + 1);
+      }
+      if (console_cell[i].top != fg) {
+        fg = console_cell[i].top;
+        p += sprintf(p, "\x1b[38;2;%d;%d;%dm",
+          palette_rgb[fg][0], palette_rgb[fg][1], palette_rgb[fg][2]);
+      }
+      if (console_cell[i].bottom != bg) {
+        bg = console_cell[i].bottom;
+        p += sprintf(p, "\x1b[48;2;%d;%d;%dm",
+          palette_rgb[bg][0], palette_rgb[bg][1], palette_rgb[bg][2]);
+      }
+      memcpy(p, "\xe2\x96\x80", 3); /* U+2580 Upper Half Block */
+      p += 3;
+
+      console_cell_shown[i] = console_cell[i];
+      next_y = y;
+      next_x = x + 1;
+    }
+  }
+
+  if (status != NULL) {
+    /* Clipped to the width, so it never wraps and scrolls the picture. */
+    len = strlen(status);
+    if (len > console_maxx) {
+      len = console_maxx;
+    }
+    p += sprintf(p, "\x1b[%d;1H\x1b[0;7m%.*s", console_maxy, len, status);
+    /* Cells below the status line must be redrawn when it goes away. */
+    for (x = 0; x < len; x++) {
+      i = ((console_maxy - 1) * console_maxx) + x;
+      console_cell_shown[i].top    = CONSOLE_ANSI_UNKNOWN;
+      console_cell_shown[i].bottom = CONSOLE_ANSI_UNKNOWN;
+    }
+  }
+
+  if (p == console_ansi_buffer) {
+    return;
+  }
+  p += sprintf(p, "\x1b[0m");
+
+  /* Whole frame in as few write() calls as the terminal allows. */
+  i = 0;
+  while (console_ansi_buffer + i < p) {
+    n = write(STDOUT_FILENO, console_ansi_buffer + i,
+      p - (console_ansi_buffer + i));
+    if (n <= 0) {
+      break;
+    }
+    i += n;
+  }
+}
+
+
+
+static long console_usec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+
+
+static const char *console_status(void)
+{
+  static char status[CONSOLE_STATUS_SIZE];
+  struct timespec ts;
+
+  /* Count presented versus emulated frames every second. */
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  if (ts.tv_sec != console_fps_second) {
+    console_fps_second = ts.tv_sec;
+    console_fps_emulated = console_frames_emulated;
+    console_fps_presented = console_frames_presented;
+    console_frames_emulated = 0;
+    console_frames_presented = 0;
+  }
+
+  /* Only shown while frames are being skipped. */
+  if (console_skip == 0 &&
+      console_fps_presented >= console_fps_emulated) {
+    if (console_status_shown) {
+      console_status_shown = false;
+      console_invalidate();
+    }
+    return NULL;
+  }
+
+  snprintf(status, sizeof(status), " FPS: %d/%d (Skip: %d) ",
+    console_fps_presented, console_fps_emulated, console_skip);
+  console_status_shown = true;
+  return status;
+}
+
+
+
+void console_poll(void)
 {
   static int cycle = 0;
   int c;
@@ -230,88 +532,168 @@ void console_update(void)
       break;
     }
   }
-
-  /* Update screen: */
-  refresh();
 }
 
 
 
-void console_draw_scanline(uint16_t y, uint8_t colors[], tia_object_t object[])
+void console_update(void)
 {
-  static int vblank_start = 0;
-  static int vblank_end = 228;
-  int con_y;
-  int con_x;
-  int pos;
-  uint8_t color_pair;
+  long start;
+  long elapsed;
+  const char *status;
 
   if (! console_active) {
     return;
   }
 
-  if (console_vblank_strip) {
-    /* Strip VBLANK from top/bottom to save precious console real estate. */
-    con_y = (int)((y - vblank_start) / 
-      ((vblank_end - vblank_start) / (float)console_maxy));
+  start = console_usec();
+
+  console_frames_emulated++;
+  if (console_skip_frame) {
+    console_skip_remaining--;
+
   } else {
-    con_y = (int)(y / (228 / (float)console_maxy));
+    /* Update screen: */
+    status = console_status();
+    if (console_ansi) {
+      console_ansi_present(status);
+    } else {
+      if (status != NULL) {
+        attron(A_REVERSE);
+        mvaddnstr(console_maxy - 1, 0, status, console_maxx);
+        attroff(A_REVERSE);
+        /* Clear what is left of a longer status shown before. */
+        if ((int)strlen(status) < console_maxx) {
+          clrtoeol();
+        }
+      }
+      refresh();
+    }
+    console_frames_presented++;
+
+    /* A slow terminal blocks on output, so adapt skipping on drain time. */
+    elapsed = console_usec() - start;
+    if (elapsed > CONSOLE_DRAIN_BUDGET) {
+      if (console_skip < CONSOLE_SKIP_MAX) {
+        console_skip++;
+      }
+    } else if (elapsed < CONSOLE_DRAIN_BUDGET / 4 && console_skip > 0) {
+      console_skip--;
+    }
+    console_skip_remaining = console_skip;
   }
+  console_skip_frame = (console_skip_remaining > 0);
+}
 
-  for (con_x = 0; con_x < console_maxx; con_x++) {
-    pos = (int)(con_x / (console_maxx / 160.0));
 
-    if (console_colors) {
-      color_pair = colors[pos] + 1;
-      attron(COLOR_PAIR(color_pair));
+
+static void console_ansi_draw(int row, uint8_t colors[],
+  tia_object_t object[])
+{
+  int con_x;
+  int pos;
+  console_cell_t *cell;
+
+  cell = &console_cell[(row / 2) * console_maxx];
+  for (con_x = 0; con_x < console_maxx; con_x++) {
+    pos = console_column_pos[con_x];
+    if (console_vblank_strip && object[pos] == TIA_OBJECT_VB) {
+      continue;
+    }
+    if (row % 2 == 0) {
+      cell[con_x].top = colors[pos] % PALETTE_COLORS;
+    } else {
+      cell[con_x].bottom = colors[pos] % PALETTE_COLORS;
     }
+  }
+}
 
-    switch (object[pos]) {
-    case TIA_OBJECT_PF:
-      mvaddch(con_y, con_x, '#');
-      break;
 
-    case TIA_OBJECT_VB:
-      if (console_vblank_strip) {
-        /* Learn the start and end of VBLANK for automatic adjustment. */
-        if (y < 50 && y > vblank_start) {
-          vblank_start = y;
-        } else if (y > 150 && y < vblank_end) {
-          vblank_end = y;
-        }
-      } else {
-        mvaddch(con_y, con_x, ' ');
-      }
-      break;
 
-    case TIA_OBJECT_BK:
-    case TIA_OBJECT_HM:
-      mvaddch(con_y, con_x, ' ');
-      break;
+void console_draw_scanline(uint16_t y, uint8_t colors[], tia_object_t object[])
+{
+  int con_y;
+  int con_x;
+  int start;
+  int len;
+  int pos;
+  uint8_t color;
+  uint32_t hash;
+  bool vblank;
 
-    case TIA_OBJECT_P0:
-      mvaddch(con_y, con_x, '1');
-      break;
+  if (! console_active || console_skip_frame || y >= CONSOLE_SCANLINES) {
+    return;
+  }
 
-    case TIA_OBJECT_P1:
-      mvaddch(con_y, con_x, '2');
-      break;
+  /* FNV-1a hash of the scanline, also checking for VBLANK on the way. */
+  hash = 2166136261;
+  vblank = false;
+  for (pos = 0; pos < TIA_SCANLINE_WIDTH; pos++) {
+    hash = (hash ^ colors[pos]) * 16777619;
+    hash = (hash ^ object[pos]) * 16777619;
+    if (object[pos] == TIA_OBJECT_VB) {
+      vblank = true;
+    }
+  }
 
-    case TIA_OBJECT_M0:
-    case TIA_OBJECT_M1:
-      mvaddch(con_y, con_x, '%');
-      break;
+  if (console_vblank_strip && vblank) {
+    /* Learn the start and end of VBLANK for automatic adjustment. */
+    if (y < 50 && y > console_vblank_start) {
+      console_vblank_start = y;
+      console_map_rows();
+    } else if (y > 150 && y < console_vblank_end) {
+      console_vblank_end = y;
+      console_map_rows();
+    }
+  }
 
-    case TIA_OBJECT_BL:
-      mvaddch(con_y, con_x, '*');
-      break;
+  con_y = console_scanline_row_map[y];
+  if (con_y < 0) {
+    return;
+  }
 
-    default:
-      break;
+  if (console_scanline_drawn[y] && console_scanline_hash[y] == hash) {
+    return;
+  }
+  console_scanline_hash[y] = hash;
+  console_scanline_drawn[y] = true;
+
+  if (console_ansi) {
+    console_ansi_draw(con_y, colors, object);
+    return;
+  }
+
+  /* Output runs of cells with the same color pair in one call. */
+  con_x = 0;
+  while (con_x < console_maxx) {
+    pos = console_column_pos[con_x];
+    if (console_vblank_strip && object[pos] == TIA_OBJECT_VB) {
+      con_x++;
+      continue;
+    }
+
+    color = colors[pos];
+    start = con_x;
+    len = 0;
+    while (con_x < console_maxx) {
+      pos = console_column_pos[con_x];
+      if (console_colors && colors[pos] != color) {
+        break;
+      }
+      if (console_vblank_strip && object[pos] == TIA_OBJECT_VB) {
+        break;
+      }
+      console_line[len] = console_object_glyph[object[pos]];
+      len++;
+      con_x++;
     }
 
     if (console_colors) {
-      attroff(COLOR_PAIR(color_pair));
+      attron(COLOR_PAIR(color + 1));
+    }
+    mvaddnstr(con_y, start, console_line, len);
+    if (console_colors) {
+      attroff(COLOR_PAIR(color + 1));
     }
   }
 }
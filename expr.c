@@ -0,0 +1,322 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+#include "expr.h"
+#include "mos6507.h"
+#include "mem.h"
+
+
+
+/* Expressions are compiled once into a postfix program for a small stack
+   machine, so evaluating one per instruction is just a loop over opcodes
+   with no parsing or function calls. */
+typedef enum {
+  EXPR_OP_CONST,
+  EXPR_OP_PC,
+  EXPR_OP_A,
+  EXPR_OP_X,
+  EXPR_OP_Y,
+  EXPR_OP_SP,
+  EXPR_OP_FRAME,
+  EXPR_OP_SCANLINE,
+  EXPR_OP_DOT,
+  EXPR_OP_RAM,
+  EXPR_OP_MEM,
+  EXPR_OP_NOT,
+  EXPR_OP_INV,
+  EXPR_OP_NEG,
+  EXPR_OP_LOR,
+  EXPR_OP_LAND,
+  EXPR_OP_OR,
+  EXPR_OP_XOR,
+  EXPR_OP_AND,
+  EXPR_OP_EQ,
+  EXPR_OP_NE,
+  EXPR_OP_LT,
+  EXPR_OP_LE,
+  EXPR_OP_GT,
+  EXPR_OP_GE,
+  EXPR_OP_SHL,
+  EXPR_OP_SHR,
+  EXPR_OP_ADD,
+  EXPR_OP_SUB,
+  EXPR_OP_MUL,
+} expr_op_t;
+
+typedef struct expr_symbol_s {
+  const char *name;
+  int level; /* Precedence for operators, as in C. */
+  expr_op_t op;
+} expr_symbol_t;
+
+
+
+/* Longer tokens first, so "<=" is not taken as "<". */
+static const expr_symbol_t expr_operators[] = {
+  {"||", 1, EXPR_OP_LOR},
+  {"&&", 2, EXPR_OP_LAND},
+  {"==", 6, EXPR_OP_EQ},
+  {"!=", 6, EXPR_OP_NE},
+  {"<=", 7, EXPR_OP_LE},
+  {">=", 7, EXPR_OP_GE},
+  {"<<", 8, EXPR_OP_SHL},
+  {">>", 8, EXPR_OP_SHR},
+  {"|",  3, EXPR_OP_OR},
+  {"^",  4, EXPR_OP_XOR},
+  {"&",  5, EXPR_OP_AND},
+  {"<",  7, EXPR_OP_LT},
+  {">",  7, EXPR_OP_GT},
+  {"+",  9, EXPR_OP_ADD},
+  {"-",  9, EXPR_OP_SUB},
+  {"*", 10, EXPR_OP_MUL},
+  {NULL, 0, 0},
+};
+
+static const expr_symbol_t expr_variables[] = {
+  {"pc",       0, EXPR_OP_PC},
+  {"a",        0, EXPR_OP_A},
+  {"x",        0, EXPR_OP_X},
+  {"y",        0, EXPR_OP_Y},
+  {"sp",       0, EXPR_OP_SP},
+  {"frame",    0, EXPR_OP_FRAME},
+  {"scanline", 0, EXPR_OP_SCANLINE},
+  {"sl",       0, EXPR_OP_SCANLINE},
+  {"dot",      0, EXPR_OP_DOT},
+  {"ram",      0, EXPR_OP_RAM}, /* Indexed with [] */
+  {"mem",      0, EXPR_OP_MEM},
+  {NULL, 0, 0},
+};
+
+static const char *expr_text;
+static expr_t *expr_out;
+static int expr_depth;
+static bool expr_error;
+
+
+
+static void expr_emit(expr_op_t op, int32_t arg)
+{
+  if (expr_out->size >= EXPR_CODE_MAX) {
+    expr_error = true;
+    return;
+  }
+  expr_out->op[expr_out->size] = op;
+  expr_out->arg[expr_out->size] = arg;
+  expr_out->size++;
+
+  /* Track the stack use, so evaluation never needs to check it. */
+  if (op <= EXPR_OP_DOT) {
+    expr_depth++;
+  } else if (op >= EXPR_OP_LOR) {
+    expr_depth--;
+  }
+  if (expr_depth > EXPR_STACK_MAX) {
+    expr_error = true;
+  }
+}
+
+
+
+static void expr_skip_space(void)
+{
+  while (isspace(*expr_text)) {
+    expr_text++;
+  }
+}
+
+
+
+static bool expr_expect(char c)
+{
+  expr_skip_space();
+  if (*expr_text != c) {
+    expr_error = true;
+    return false;
+  }
+  expr_text++;
+  return true;
+}
+
+
+
+static void expr_parse(int level);
+
+static void expr_parse_unary(void)
+{
+  const expr_symbol_t *symbol;
+  char *end;
+  size_t len;
+
+  expr_skip_space();
+
+  switch (*expr_text) {
+  case '!':
+    expr_text++;
+    expr_parse_unary();
+    expr_emit(EXPR_OP_NOT, 0);
+    return;
+
+  case '~':
+    expr_text++;
+    expr_parse_unary();
+    expr_emit(EXPR_OP_INV, 0);
+    return;
+
+  case '-':
+    expr_text++;
+    expr_parse_unary();
+    expr_emit(EXPR_OP_NEG, 0);
+    return;
+
+  case '(':
+    expr_text++;
+    expr_parse(1);
+    expr_expect(')');
+    return;
+
+  case '$':
+    expr_text++;
+    if (! isxdigit(*expr_text)) {
+      expr_error = true;
+      return;
+    }
+    expr_emit(EXPR_OP_CONST, strtol(expr_text, &end, 16));
+    expr_text = end;
+    return;
+
+  default:
+    break;
+  }
+
+  if (isdigit(*expr_text)) {
+    if (expr_text[0] == '0' && (expr_text[1] == 'x' || expr_text[1] == 'X')) {
+      expr_emit(EXPR_OP_CONST, strtol(expr_text + 2, &end, 16));
+    } else {
+      expr_emit(EXPR_OP_CONST, strtol(expr_text, &end, 10));
+    }
+    expr_text = end;
+    return;
+  }
+
+  for (len = 0; isalnum(expr_text[len]); len++);
+  for (symbol = expr_variables; symbol->name != NULL; symbol++) {
+    if (strlen(symbol->name) == len &&
+      strncmp(symbol->name, expr_text, len) == 0) {
+      break;
+    }
+  }
+  if (len == 0 || symbol->name == NULL) {
+    expr_error = true;
+    return;
+  }
+  expr_text += len;
+
+  if (symbol->op == EXPR_OP_RAM || symbol->op == EXPR_OP_MEM) {
+    if (expr_expect('[')) {
+      expr_parse(1);
+      expr_expect(']');
+    }
+  }
+  expr_emit(symbol->op, 0);
+}
+
+
+
+static void expr_parse(int level)
+{
+  const expr_symbol_t *symbol;
+
+  /* Precedence climbing, left associative. */
+  expr_parse_unary();
+  while (! expr_error) {
+    expr_skip_space();
+    for (symbol = expr_operators; symbol->name != NULL; symbol++) {
+      if (strncmp(symbol->name, expr_text, strlen(symbol->name)) == 0) {
+        break;
+      }
+    }
+    if (symbol->name == NULL || symbol->level < level) {
+      break;
+    }
+    expr_text += strlen(symbol->name);
+    expr_parse(symbol->level + 1);
+    expr_emit(symbol->op, 0);
+  }
+}
+
+
+
+int expr_compile(expr_t *expr, const char *text)
+{
+  expr_text = text;
+  expr_out = expr;
+  expr_out->size = 0;
+  expr_depth = 0;
+  expr_error = false;
+
+  expr_parse(1);
+  expr_skip_space();
+  if (expr_error || *expr_text != '\0') {
+    expr->size = 0;
+    return -1;
+  }
+  return 0;
+}
+
+
+
+int32_t expr_eval(const expr_t *expr, const expr_env_t *env)
+{
+  int32_t stack[EXPR_STACK_MAX];
+  int32_t *top = stack - 1;
+  int i;
+
+  for (i = 0; i < expr->size; i++) {
+    switch (expr->op[i]) {
+    case EXPR_OP_CONST:    *++top = expr->arg[i]; break;
+    case EXPR_OP_PC:       *++top = env->cpu->pc; break;
+    case EXPR_OP_A:        *++top = env->cpu->a; break;
+    case EXPR_OP_X:        *++top = env->cpu->x; break;
+    case EXPR_OP_Y:        *++top = env->cpu->y; break;
+    case EXPR_OP_SP:       *++top = env->cpu->sp; break;
+    case EXPR_OP_FRAME:    *++top = env->frame; break;
+    case EXPR_OP_SCANLINE: *++top = env->scanline; break;
+    case EXPR_OP_DOT:      *++top = env->dot; break;
+
+    /* RAM is indexed by either $00-$7F or its address $80-$FF. */
+    case EXPR_OP_RAM: *top = mem_peek(env->mem, 0x80 | (*top & 0x7F)); break;
+    case EXPR_OP_MEM: *top = mem_peek(env->mem, *top & 0x1FFF); break;
+
+    case EXPR_OP_NOT: *top = ! *top; break;
+    case EXPR_OP_INV: *top = ~ *top; break;
+    case EXPR_OP_NEG: *top = -(uint32_t)*top; break;
+
+    case EXPR_OP_LOR:  top--; *top = *top || top[1]; break;
+    case EXPR_OP_LAND: top--; *top = *top && top[1]; break;
+    case EXPR_OP_OR:   top--; *top = *top |  top[1]; break;
+    case EXPR_OP_XOR:  top--; *top = *top ^  top[1]; break;
+    case EXPR_OP_AND:  top--; *top = *top &  top[1]; break;
+    case EXPR_OP_EQ:   top--; *top = *top == top[1]; break;
+    case EXPR_OP_NE:   top--; *top = *top != top[1]; break;
+    case EXPR_OP_LT:   top--; *top = *top <  top[1]; break;
+    case EXPR_OP_LE:   top--; *top = *top <= top[1]; break;
+    case EXPR_OP_GT:   top--; *top = *top >  top[1]; break;
+    case EXPR_OP_GE:   top--; *top = *top >= top[1]; break;
+    case EXPR_OP_SHL:  top--; *top = (uint32_t)*top << (top[1] & 31); break;
+    case EXPR_OP_SHR:  top--; *top = *top >> (top[1] & 31); break;
+    case EXPR_OP_ADD:  top--; *top = (uint32_t)*top + top[1]; break;
+    case EXPR_OP_SUB:  top--; *top = (uint32_t)*top - top[1]; break;
+    case EXPR_OP_MUL:  top--; *top = (uint32_t)*top * top[1]; break;
+    default:
+      break;
+    }
+  }
+
+  return (top >= stack) ? *top : 0;
+}
+
+
+
@@ -0,0 +1,29 @@
+#ifndef _EXPR_H
+#define _EXPR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mos6507.h"
+#include "mem.h"
+
+#define EXPR_CODE_MAX 64
+#define EXPR_STACK_MAX 16
+
+typedef struct expr_env_s {
+  mos6507_t *cpu;
+  mem_t *mem;
+  uint32_t frame;
+  int scanline;
+  int dot;
+} expr_env_t;
+
+typedef struct expr_s {
+  uint8_t op[EXPR_CODE_MAX];
+  int32_t arg[EXPR_CODE_MAX];
+  int size;
+} expr_t;
+
+int expr_compile(expr_t *expr, const char *text);
+int32_t expr_eval(const expr_t *expr, const expr_env_t *env);
+
+#endif /* _EXPR_H */
@@ -12,6 +12,9 @@ bool gui_get_joystick_button_p0(void);
 bool gui_get_joystick_button_p1(void);
 bool gui_save_state_requested(void);
 bool gui_load_state_requested(void);
+int gui_get_state_slot(void);
+bool gui_rewind_requested(void);
+void gui_poll(void);
 void gui_update(void);
 
 #endif /* _GUI_H */
@@ -0,0 +1,78 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "input.h"
+#include "gui.h"
+#include "console.h"
+#include "tas.h"
+
+/* Input only changes between frames, when the GUI and console handle their
+   events or the TAS moves on, so it is sampled once then and the PIA/TIA
+   read paths use the copy. */
+static uint8_t input_system_switches = 0xB;
+static uint8_t input_joystick_movement = 0xFF;
+static bool input_joystick_button_p0 = true;
+static bool input_joystick_button_p1 = true;
+
+
+
+void input_latch(void)
+{
+  if (tas_is_active()) {
+    input_system_switches    = tas_get_system_switches();
+    input_joystick_movement  = tas_get_joystick_movement();
+    input_joystick_button_p0 = tas_get_joystick_button_p0();
+    input_joystick_button_p1 = tas_get_joystick_button_p1();
+  } else {
+    input_system_switches    = gui_get_system_switches() &
+                               console_get_system_switches();
+    input_joystick_movement  = gui_get_joystick_movement() &
+                               console_get_joystick_movement();
+    input_joystick_button_p0 = gui_get_joystick_button_p0() &
+                               console_get_joystick_button_p0();
+    input_joystick_button_p1 = gui_get_joystick_button_p1() &
+                               console_get_joystick_button_p1();
+  }
+}
+
+
+
+uint8_t input_get_system_switches(void)
+{
+  return input_system_switches;
+}
+
+
+
+uint8_t input_get_joystick_movement(void)
+{
+  return input_joystick_movement;
+}
+
+
+
+bool input_get_joystick_button_p0(void)
+{
+  return input_joystick_button_p0;
+}
+
+
+
+bool input_get_joystick_button_p1(void)
+{
+  return input_joystick_button_p1;
+}
+
+
+
+void input_set(uint8_t system_switches, uint8_t joystick_movement,
+  bool joystick_button_p0, bool joystick_button_p1)
+{
+  input_system_switches    = system_switches;
+  input_joystick_movement  = joystick_movement;
+  input_joystick_button_p0 = joystick_button_p0;
+  input_joystick_button_p1 = joystick_button_p1;
+}
+
+
+
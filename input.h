@@ -0,0 +1,15 @@
+#ifndef _INPUT_H
+#define _INPUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+void input_latch(void);
+uint8_t input_get_system_switches(void);
+uint8_t input_get_joystick_movement(void);
+bool input_get_joystick_button_p0(void);
+bool input_get_joystick_button_p1(void);
+void input_set(uint8_t system_switches, uint8_t joystick_movement,
+  bool joystick_button_p0, bool joystick_button_p1);
+
+#endif /* _INPUT_H */
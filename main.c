@@ -16,6 +16,23 @@
 #include "gui.h"
 #include "console.h"
 #include "tas.h"
+#include "state.h"
+#include "rewind.h"
+#include "reverse.h"
+#include "input.h"
+#include "breakpoint.h"
+#include "expr.h"
+#include "timeline.h"
+#include "search.h"
+
+#define FRAME_STEPS_MAX 100000 /* Give up if VSYNC never comes. */
+#define IDLE_CYCLES_MAX 0x4000 /* Longest skip before looking again. */
+
+typedef enum {
+  REPLAY_NONE,
+  REPLAY_STEP_BACK,
+  REPLAY_CONTINUE_BACK,
+} replay_request_t;
 
 
 
@@ -30,19 +47,31 @@ static bool vsync_break    = false;
 static bool rdy_break      = false;
 static char panic_msg[80];
 static uint32_t frame_no;
+static char *state_prefix = NULL;
+static bool redraw_done;
+static int run_ahead = 0;
+static bool trace_to_file = false;
+static bool timeline_to_file = false;
+static bool break_armed = false;
+static replay_request_t replay_request = REPLAY_NONE;
+static bool replaying = false;
+static uint64_t reverse_next = 0;
+
 
-static mos6507_t save_cpu;
-static mem_t save_mem;
-static pia_t save_pia;
-static tia_t save_tia;
-static cart_t save_cart;
-static bool saved_state = false;
+
+static void history_reset(void)
+{
+  /* Reverse stepping only works on the timeline it was recorded on. */
+  reverse_init();
+  reverse_record_input(frame_no);
+  reverse_next = pia.clock;
+}
 
 
 
 static bool debugger(void)
 {
-  char cmd[16];
+  char cmd[80];
 
   fprintf(stdout, "\n");
   while (1) {
@@ -66,11 +95,25 @@ static bool debugger(void)
       fprintf(stdout, "  v - Continue until next VSYNC\n");
       fprintf(stdout, "  b - Continue until RDY released\n");
       fprintf(stdout, "  s - Step\n");
+      fprintf(stdout, "  S - Reverse Step\n");
+      fprintf(stdout, "  C - Reverse Continue until previous break\n");
       fprintf(stdout, "  1 - Dump CPU Trace\n");
       fprintf(stdout, "  2 - Dump RAM\n");
       fprintf(stdout, "  3 - Dump PIA Info\n");
       fprintf(stdout, "  4 - Dump TIA Info\n");
       fprintf(stdout, "  5 - Dump Cartridge\n");
+      fprintf(stdout, "  w - Write State to Slot\n");
+      fprintf(stdout, "  l - Load State from Slot\n");
+      fprintf(stdout, "  r - Rewind One Frame\n");
+      fprintf(stdout, "  6 - Dump Rewind Info\n");
+      fprintf(stdout, "  k - List Breakpoints\n");
+      fprintf(stdout, "  k x ADDR - Toggle Breakpoint on Execution\n");
+      fprintf(stdout, "  k r ADDR - Toggle Watchpoint on Read\n");
+      fprintf(stdout, "  k w ADDR - Toggle Watchpoint on Write\n");
+      fprintf(stdout, "  k l LINE[,DOT] - Toggle Breakpoint on Beam\n");
+      fprintf(stdout, "  k f FRAME - Toggle Breakpoint on Frame\n");
+      fprintf(stdout, "  k ? EXPR - Toggle Breakpoint on Condition\n");
+      fprintf(stdout, "  k c - Clear Breakpoints\n");
       break;
 
     case 'c': /* Continue */
@@ -87,6 +130,14 @@ static bool debugger(void)
     case 's': /* Step */
       return true;
 
+    case 'S': /* Reverse Step */
+      replay_request = REPLAY_STEP_BACK;
+      return true;
+
+    case 'C': /* Reverse Continue */
+      replay_request = REPLAY_CONTINUE_BACK;
+      return true;
+
     case 'q': /* Quit */
       exit(EXIT_SUCCESS);
       break;
@@ -112,6 +163,43 @@ static bool debugger(void)
       mem_dump(stdout, &mem, 0xF000, 0xFFFF); /* Mapped address space. */
       break;
 
+    case 'w':
+      if (state_save_slot(state_prefix, gui_get_state_slot(),
+        &cpu, &mem) != 0) {
+        fprintf(stdout, "Failed to save state!\n");
+      }
+      break;
+
+    case 'l':
+      if (state_load_slot(state_prefix, gui_get_state_slot(),
+        &cpu, &mem) != 0) {
+        fprintf(stdout, "Failed to load state!\n");
+      }
+      redraw_done = tia.vsync; /* Do not count the same frame twice. */
+      history_reset();
+      break;
+
+    case 'r':
+      if (rewind_step(&cpu, &mem) != 0) {
+        fprintf(stdout, "Nothing more to rewind!\n");
+      } else {
+        frame_no--;
+      }
+      redraw_done = tia.vsync;
+      history_reset();
+      break;
+
+    case '6':
+      rewind_dump(stdout);
+      break;
+
+    case 'k':
+      if (breakpoint_command(stdout, &cmd[1]) != 0) {
+        fprintf(stdout, "Invalid breakpoint!\n");
+      }
+      break_armed = breakpoint_armed();
+      break;
+
     default:
       continue;
     }
@@ -148,16 +236,321 @@ void debug(void)
 
 
 
-void sync(void)
+static void sync_tia(uint32_t cycles)
 {
-  /* Run PIA and TIA one CPU clock at a time: */
-  while (cpu.cycles > 0) {
-    pia_execute(&pia);
+  /* Run TIA one CPU clock at a time: */
+  while (cycles > 0) {
     tia_execute(&tia);
     tia_execute(&tia);
     tia_execute(&tia);
-    cpu.cycles--;
+    cycles--;
+  }
+}
+
+
+
+void sync(void)
+{
+  /* The PIA works out its timer from the clock when accessed. */
+  pia.clock += cpu.cycles;
+  sync_tia(cpu.cycles);
+  cpu.cycles = 0;
+}
+
+
+
+static bool idle_branch_taken(uint8_t opcode, uint8_t value)
+{
+  switch (opcode) {
+  case 0x10: /* BPL */
+    return (value & 0x80) == 0;
+  case 0x30: /* BMI */
+    return (value & 0x80) != 0;
+  case 0xD0: /* BNE */
+    return value != 0;
+  case 0xF0: /* BEQ */
+    return value == 0;
+  default:
+    return false;
+  }
+}
+
+
+
+static void idle_skip(void)
+{
+  uint16_t pc, address;
+  uint8_t branch;
+  uint32_t loop_cycles, cycles;
+
+  /* Look for "LDA INTIM" and a branch back to it, which only waits on the
+     PIA timer. The code must be clear of the hotspots, since the skipped
+     passes do not fetch it. */
+  pc = cpu.pc & 0x1FFF;
+  if ((pc & 0x1000) == 0 || (pc & 0xFFF) + 4 >= cart.hotspot) {
+    return;
+  }
+  if (mem_peek(&mem, pc) != 0xAD || mem_peek(&mem, pc + 4) != 0xFB) {
+    return;
+  }
+  address = mem_peek(&mem, pc + 1) + (mem_peek(&mem, pc + 2) * 256);
+  if (address != PIA_INTIM && address != PIA_INTIM_COPY) {
+    return;
+  }
+  branch = mem_peek(&mem, pc + 3);
+
+  loop_cycles = 4 + 3;
+  if (((pc + 5) & 0xFF00) != (pc & 0xFF00)) {
+    loop_cycles++; /* Branch crosses a page boundary. */
   }
+
+  /* Do the reads of each pass that keeps looping on the PIA alone, and
+     leave the one that ends the loop to the CPU. The TIA only needs to
+     catch up afterwards, since nothing it does is seen by the loop. */
+  cycles = 0;
+  while (cycles < IDLE_CYCLES_MAX &&
+         idle_branch_taken(branch, pia_timer(&pia))) {
+    mem_read(&mem, address);
+    pia.clock += loop_cycles;
+    cycles += loop_cycles;
+  }
+  sync_tia(cycles);
+}
+
+
+
+static void trace_file_add(void)
+{
+  mos6507_trace_where_t where;
+  int i;
+
+  where.cycle    = pia.clock;
+  where.frame    = frame_no;
+  where.scanline = tia.scanline;
+  where.dot      = tia.dot;
+  for (i = 0; i < MOS6507_TRACE_BANKS; i++) {
+    where.bank[i] = cart.bank.select[i];
+  }
+  mos6507_trace_file_add(&cpu, &mem, &where);
+}
+
+
+
+static void execute(bool trace)
+{
+  if (tia.rdy) {
+    /* A trace file or timeline should have every access, and breakpoints
+       should see them all, so no skipping then. */
+    if (! debugger_break && ! trace_to_file && ! timeline_to_file &&
+      ! break_armed && ! replaying) {
+      idle_skip();
+    }
+    if (trace) {
+      mos6507_trace_add(&cpu, &mem);
+      if (trace_to_file) {
+        trace_file_add();
+      }
+    }
+    if (timeline_to_file) {
+      timeline_instruction(cpu.pc);
+    }
+    mos6507_execute(&cpu, &mem);
+  } else {
+    /* CPU halted by RDY, run all the cycles until it is released at once: */
+    cpu.cycles += tia_rdy_cycles(&tia);
+  }
+
+  /* Run TIA/PIA to catch up to CPU: */
+  sync();
+}
+
+
+
+static void run_frame(void)
+{
+  bool vsync;
+  int steps;
+
+  /* Run until the next VSYNC, same as a frame in the main loop. */
+  vsync = tia.vsync;
+  for (steps = 0; steps < FRAME_STEPS_MAX; steps++) {
+    execute(false);
+    if (tia.vsync && ! vsync) {
+      break;
+    }
+    vsync = tia.vsync;
+  }
+}
+
+
+
+static void run_ahead_frames(int frames)
+{
+  uint8_t state[STATE_SIZE_MAX];
+  char msg[sizeof(panic_msg)];
+  uint64_t clock;
+  size_t size;
+  bool audio, brk;
+  int i;
+
+  /* Emulate ahead with the current input, keeping only the picture of the
+     last frame, then go back so the real frames run as normal. The clock
+     goes back too, since it is not part of the state, and so does any
+     break into the debugger for something that never really happened. */
+  size = state_save(state, &cpu, &mem);
+  clock = pia.clock;
+  brk = debugger_break;
+  strcpy(msg, panic_msg);
+  audio = tia.audio;
+  tia.audio = false;
+  timeline_suspend(true);
+  breakpoint_suspend(true);
+
+  for (i = 0; i < frames; i++) {
+    tia.render = (i == frames - 1);
+    run_frame();
+  }
+
+  pia.clock = clock;
+  state_load(state, size, &cpu, &mem);
+  debugger_break = brk;
+  strcpy(panic_msg, msg);
+  tia.render = false; /* Real frame is not shown, the future one is. */
+  tia.audio = audio;
+  timeline_suspend(false);
+  breakpoint_suspend(false);
+}
+
+
+
+static void search(void)
+{
+  /* Search from here, once any TAS input given has been played. */
+  if (search_run(&cpu, &mem, run_frame) != 0) {
+    fprintf(stderr, "Input search failed!\n");
+    exit(EXIT_FAILURE);
+  }
+  exit(EXIT_SUCCESS);
+}
+
+
+
+static void latch_input(void)
+{
+  /* Sample the input that the next frame will see, and record it. */
+  input_latch();
+  tas_record(input_get_system_switches(), input_get_joystick_movement(),
+    input_get_joystick_button_p0(), input_get_joystick_button_p1());
+}
+
+
+
+static bool replay_step(void)
+{
+  bool hit;
+
+  /* Same as a step of the main loop, with nothing shown or recorded, and
+     returns if it would have broken into the debugger. */
+  debugger_break = false;
+  panic_msg[0] = '\0';
+  breakpoint_message(NULL);
+
+  execute(false);
+  hit = debugger_break; /* Watchpoint or panic. */
+  if (break_armed &&
+    breakpoint_check(tia.rdy, frame_no, tia.scanline, tia.dot)) {
+    hit = true;
+  }
+
+  if (tia.vsync) {
+    if (! redraw_done) {
+      reverse_replay_input(frame_no + 1);
+      redraw_done = true;
+      frame_no++;
+    }
+  } else {
+    redraw_done = false;
+  }
+
+  return hit;
+}
+
+
+
+static bool replay_restore(uint64_t before)
+{
+  if (reverse_restore(before, &cpu, &mem, &frame_no, &redraw_done) != 0) {
+    return false;
+  }
+  breakpoint_restart();
+  return true;
+}
+
+
+
+static void replay(bool to_break)
+{
+  uint64_t before, upper, start, found;
+  bool render, audio, restored, has_found, hit;
+
+  /* Go back to the previous instruction, or to the previous place it would
+     have broken into the debugger. Each snapshot, newest first, is run
+     forward to find the last such place before the upper limit, and when
+     found the snapshot is loaded again and run up to there. */
+  render = tia.render;
+  audio = tia.audio;
+  tia.render = false;
+  tia.audio = false;
+  replaying = true;
+  timeline_suspend(true);
+
+  before = pia.clock;
+  upper = pia.clock;
+  start = 0;
+  restored = false;
+  has_found = false;
+  found = 0;
+  while (replay_restore(before)) {
+    restored = true;
+    start = pia.clock;
+    has_found = ! to_break; /* The snapshot itself is an instruction. */
+    found = start;
+    while (1) {
+      hit = replay_step();
+      if (pia.clock >= upper) {
+        break;
+      }
+      if (hit || ! to_break) {
+        has_found = true;
+        found = pia.clock;
+      }
+    }
+    if (has_found) {
+      break;
+    }
+    before = start;
+    upper = start + 1; /* Include the snapshot position itself. */
+  }
+
+  if (restored) {
+    replay_restore(start + 1);
+    while (pia.clock < found) {
+      replay_step();
+    }
+    if (! has_found) {
+      fprintf(stdout, "Reached start of reverse history!\n");
+    }
+    reverse_next = pia.clock;
+  } else {
+    fprintf(stdout, "No reverse history!\n");
+  }
+
+  replaying = false;
+  tia.render = render;
+  tia.audio = audio;
+  timeline_suspend(false);
+  timeline_frame(frame_no);
+  debugger_break = true;
 }
 
 
@@ -173,8 +566,23 @@ static void display_help(const char *progname)
     "  -c        Disable Curses console.\n"
     "  -s        Do not strip VBLANK scanlines in console.\n"
     "  -k        Disable colors in console.\n"
+    "  -u        Use raw ANSI truecolor half-blocks in console.\n"
     "  -j NO     Use SDL joystick NO instead of 0.\n"
-    "  -t FILE   Use CSV FILE as input for TAS.\n"
+    "  -b TYPE   Force cartridge type: 2K, 4K, F8, F6, F4, FE, E0, 3F, E7,\n"
+    "            F8SC, F6SC, F4SC, FA.\n"
+    "  -D FILE   Look up the cartridge by ROM MD5 in database FILE.\n"
+    "  -t FILE   Use CSV or binary FILE as input for TAS.\n"
+    "  -m FILE   Record input to TAS FILE, CSV if named *.csv.\n"
+    "  -r NO     Run NO frames ahead to reduce input latency.\n"
+    "  -x SPEC   Search inputs to maximize a RAM byte, best is saved to -m.\n"
+    "            SPEC: [-]ADDR[,FRAMES[,WIDTH[,HOLD[,JOBS]]]], - minimizes.\n"
+    "  -X SPEC   Search all inputs by forking at each decision frame.\n"
+    "            SPEC: [-]ADDR[,FRAMES[,HOLD[,JOBS]]], saved to -m.\n"
+    "  -T SPEC   Trace instructions to a binary file for atarascii-trace.\n"
+    "            SPEC: FILE[,DEPTH[,COND]], DEPTH keeps only the last\n"
+    "            instructions, COND is an expression as for the debugger.\n"
+    "  -R SPEC   Record TIA/PIA register accesses to Chrome trace JSON.\n"
+    "            SPEC: FILE[,DEPTH], DEPTH is the accesses kept (262144).\n"
     "\n");
 }
 
@@ -185,15 +593,26 @@ int main(int argc, char *argv[])
   int c;
   char *rom_filename = NULL;
   char *tas_filename = NULL;
-  bool redraw_done;
+  char *record_filename = NULL;
+  char *cart_type = NULL;
+  char *cart_db = NULL;
+  char *trace_filename = NULL;
+  char *timeline_filename = NULL;
+  char *separator;
+  uint32_t trace_depth_no = 0;
+  char *trace_cond_text = NULL;
+  expr_t trace_cond;
+  uint32_t timeline_depth_no = 0;
+  bool seen;
   bool disable_video = false;
   bool disable_audio = false;
   bool disable_console = false;
   bool disable_vblank_strip = false;
   bool disable_colors = false;
+  bool ansi_output = false;
   int joystick_no = 0;
 
-  while ((c = getopt(argc, argv, "hdvacskj:t:")) != -1) {
+  while ((c = getopt(argc, argv, "hdvacskuj:t:m:r:x:X:b:D:T:R:")) != -1) {
     switch (c) {
     case 'h':
       display_help(argv[0]);
@@ -223,6 +642,10 @@ int main(int argc, char *argv[])
       disable_colors = true;
       break;
 
+    case 'u':
+      ansi_output = true;
+      break;
+
     case 'j':
       joystick_no = atoi(optarg);
       break;
@@ -231,6 +654,58 @@ int main(int argc, char *argv[])
       tas_filename = optarg;
       break;
 
+    case 'm':
+      record_filename = optarg;
+      break;
+
+    case 'r':
+      run_ahead = atoi(optarg);
+      break;
+
+    case 'b':
+      cart_type = optarg;
+      break;
+
+    case 'D':
+      cart_db = optarg;
+      break;
+
+    case 'T':
+      trace_filename = optarg;
+      separator = strchr(optarg, ',');
+      if (separator != NULL) {
+        *separator = '\0';
+        trace_depth_no = strtoul(separator + 1, NULL, 0);
+        trace_cond_text = strchr(separator + 1, ',');
+        if (trace_cond_text != NULL) {
+          trace_cond_text++;
+        }
+      }
+      break;
+
+    case 'R':
+      timeline_filename = optarg;
+      separator = strchr(optarg, ',');
+      if (separator != NULL) {
+        *separator = '\0';
+        timeline_depth_no = strtoul(separator + 1, NULL, 0);
+      }
+      break;
+
+    case 'x':
+      if (search_parse(optarg, false) != 0) {
+        fprintf(stderr, "Invalid search specification: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+
+    case 'X':
+      if (search_parse(optarg, true) != 0) {
+        fprintf(stderr, "Invalid search specification: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+
     case '?':
     default:
       display_help(argv[0]);
@@ -243,9 +718,22 @@ int main(int argc, char *argv[])
     return EXIT_FAILURE;
   } else {
     rom_filename = argv[optind];
+    state_prefix = rom_filename;
+  }
+
+  if (search_enabled()) {
+    if (record_filename == NULL) {
+      fprintf(stderr, "Input search needs a TAS file to write with -m!\n");
+      return EXIT_FAILURE;
+    }
+    disable_video = true;
+    disable_audio = true;
+    disable_console = true;
   }
 
   mos6507_trace_init();
+  rewind_init();
+  reverse_init();
   panic_msg[0] = '\0';
 
   signal(SIGINT, sig_handler);
@@ -255,10 +743,29 @@ int main(int argc, char *argv[])
   tia_init(&tia, &mem);
   cart_init(&cart, &mem);
 
-  if (cart_load(&cart, rom_filename) != 0) {
-    fprintf(stderr, "Unable to load cartridge ROM: %s\n", argv[1]);
+  /* Hooks are wrapped, so breakpoints must come after to see the timeline
+     ones as those to call on. */
+  if (timeline_filename != NULL) {
+    if (timeline_init(timeline_filename, timeline_depth_no,
+      &cpu, &mem) != 0) {
+      fprintf(stderr, "Failed to create timeline file: %s\n",
+        timeline_filename);
+      return EXIT_FAILURE;
+    }
+    timeline_to_file = true;
+  }
+  breakpoint_init(&cpu, &mem);
+
+  if (cart_load(&cart, rom_filename, cart_type, cart_db) != 0) {
+    fprintf(stderr, "Unable to load cartridge ROM: %s\n", rom_filename);
     return EXIT_FAILURE;
   }
+  if (cart.tv != CART_TV_NTSC) {
+    fprintf(stderr, "Warning: Cartridge is not NTSC, running it as NTSC.\n");
+  }
+  if (cart.controller != CART_CONTROLLER_JOYSTICK) {
+    fprintf(stderr, "Warning: Cartridge controller is not emulated.\n");
+  }
 
   if (tas_filename != NULL) {
     if (tas_init(tas_filename) != 0) {
@@ -273,23 +780,57 @@ int main(int argc, char *argv[])
   }
 
   if (! disable_console) {
-    console_init(! disable_vblank_strip, disable_colors);
+    if (console_init(! disable_vblank_strip, disable_colors,
+      ansi_output) != 0) {
+      fprintf(stderr, "Failed to initialize console!\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (record_filename != NULL) {
+    if (tas_record_init(record_filename) != 0) {
+      fprintf(stderr, "Failed to create TAS file: %s\n", record_filename);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (trace_filename != NULL) {
+    if (trace_cond_text != NULL &&
+      expr_compile(&trace_cond, trace_cond_text) != 0) {
+      fprintf(stderr, "Invalid trace condition: %s\n", trace_cond_text);
+      return EXIT_FAILURE;
+    }
+    if (mos6507_trace_file_init(trace_filename, trace_depth_no,
+      (trace_cond_text != NULL) ? &trace_cond : NULL) != 0) {
+      fprintf(stderr, "Failed to create trace file: %s\n", trace_filename);
+      return EXIT_FAILURE;
+    }
+    trace_to_file = true;
   }
 
   redraw_done = false;
   frame_no = 0;
   mos6507_reset(&cpu, &mem);
+
+  /* Search from power on if there is no TAS input to play first. Frame 0
+     is not recorded here, the search records its inputs from there on. */
+  if (search_enabled() && ! tas_is_active()) {
+    input_latch();
+    search();
+  }
+  latch_input();
+  reverse_record_input(frame_no);
+
   while (1) {
-    if (tia.rdy) {
-      mos6507_trace_add(&cpu, &mem);
-      mos6507_execute(&cpu, &mem);
-    } else {
-      /* CPU halted by RDY, but increment cycles: */
-      cpu.cycles++;
+    if (pia.clock >= reverse_next) {
+      reverse_next = reverse_capture(&cpu, &mem, frame_no, redraw_done);
     }
+    execute(true);
 
-    /* Run TIA/PIA to catch up to CPU: */
-    sync();
+    if (break_armed &&
+      breakpoint_check(tia.rdy, frame_no, tia.scanline, tia.dot)) {
+      debugger_break = true;
+    }
 
     if (rdy_break && tia.rdy) {
       rdy_break = false;
@@ -299,29 +840,54 @@ int main(int argc, char *argv[])
     /* Redraw screen on vsync: */
     if (tia.vsync) {
       if (! redraw_done) {
+        gui_poll();
+        console_poll();
+        /* Frames run again after reverse stepping replay their input. */
+        seen = reverse_replay_input(frame_no + 1);
+        if (! seen) {
+          tas_update();
+          if (search_enabled() && ! tas_is_active()) {
+            search();
+          }
+          latch_input();
+          reverse_record_input(frame_no + 1);
+        }
+        /* Run ahead on the input just latched, before showing the frame. */
+        if (run_ahead > 0) {
+          run_ahead_frames(run_ahead);
+        }
         gui_update();
         console_update();
-        tas_update();
         redraw_done = true;
         frame_no++;
+        timeline_frame(frame_no);
         if (vsync_break) {
           vsync_break = false;
           debugger_break = true;
         }
 
         if (gui_save_state_requested()) {
-          memcpy(&save_cpu,  &cpu,  sizeof(mos6507_t));
-          memcpy(&save_mem,  &mem,  sizeof(mem_t));
-          memcpy(&save_pia,  &pia,  sizeof(pia_t));
-          memcpy(&save_tia,  &tia,  sizeof(tia_t));
-          memcpy(&save_cart, &cart, sizeof(cart_t));
-          saved_state = true;
-        } else if (gui_load_state_requested() && saved_state) {
-          memcpy(&cpu,  &save_cpu,  sizeof(mos6507_t));
-          memcpy(&mem,  &save_mem,  sizeof(mem_t));
-          memcpy(&pia,  &save_pia,  sizeof(pia_t));
-          memcpy(&tia,  &save_tia,  sizeof(tia_t));
-          memcpy(&cart, &save_cart, sizeof(cart_t));
+          if (state_save_slot(state_prefix, gui_get_state_slot(),
+            &cpu, &mem) != 0) {
+            fprintf(stderr, "Failed to save state slot: %d\n",
+              gui_get_state_slot());
+          }
+        } else if (gui_load_state_requested()) {
+          if (state_load_slot(state_prefix, gui_get_state_slot(),
+            &cpu, &mem) != 0) {
+            fprintf(stderr, "Failed to load state slot: %d\n",
+              gui_get_state_slot());
+          }
+          history_reset();
+        }
+
+        if (gui_rewind_requested()) {
+          if (rewind_step(&cpu, &mem) == 0) {
+            frame_no--;
+          }
+          history_reset();
+        } else if (! seen) {
+          rewind_capture(&cpu, &mem);
         }
       }
     } else {
@@ -334,7 +900,18 @@ int main(int argc, char *argv[])
         fprintf(stdout, "%s", panic_msg);
         panic_msg[0] = '\0';
       }
+      breakpoint_message(stdout);
       debugger_break = debugger();
+      while (replay_request != REPLAY_NONE) {
+        replay(replay_request == REPLAY_CONTINUE_BACK);
+        replay_request = REPLAY_NONE;
+        if (panic_msg[0] != '\0') {
+          fprintf(stdout, "%s", panic_msg);
+          panic_msg[0] = '\0';
+        }
+        breakpoint_message(stdout);
+        debugger_break = debugger();
+      }
       if (! debugger_break) {
         console_resume();
       }
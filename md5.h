@@ -0,0 +1,11 @@
+#ifndef _MD5_H
+#define _MD5_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MD5_DIGEST_SIZE 16
+
+void md5(const uint8_t *data, size_t size, uint8_t digest[MD5_DIGEST_SIZE]);
+
+#endif /* _MD5_H */
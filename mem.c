@@ -18,6 +18,11 @@ void mem_init(mem_t *mem)
   mem->pia_write  = NULL;
   mem->cart_read  = NULL;
   mem->cart_write = NULL;
+  mem->cart_snoop_read  = NULL;
+  mem->cart_snoop_write = NULL;
+  mem->tia_peek  = NULL;
+  mem->pia_peek  = NULL;
+  mem->cart_peek = NULL;
   mem->tia  = NULL;
   mem->pia  = NULL;
   mem->cart = NULL;
@@ -27,6 +32,8 @@ void mem_init(mem_t *mem)
 
 uint8_t mem_read(mem_t *mem, uint16_t address)
 {
+  uint8_t value = 0;
+
   address &= 0x1FFF; /* Mirroring */
 
   if ((address & 0x1000) > 0) { /* A12 = 1, Cartridge */
@@ -39,20 +46,54 @@ uint8_t mem_read(mem_t *mem, uint16_t address)
   } else { /* A12 = 0 */
     if ((address & 0x80) > 0) { /* A7 = 1, PIA */
       if (mem->pia_read != NULL && mem->pia != NULL) {
-        return (mem->pia_read)(mem->pia, address);
+        value = (mem->pia_read)(mem->pia, address);
       } else {
         panic("PIA read hook not installed! Address: 0x%04x\n", address);
       }
 
     } else { /* A7 = 0, TIA */
       if (mem->tia_read != NULL && mem->tia != NULL) {
-        return (mem->tia_read)(mem->tia, address);
+        value = (mem->tia_read)(mem->tia, address);
       } else {
         panic("TIA read hook not installed! Address: 0x%04x\n", address);
       }
     }
+
+    /* Some cartridges switch banks by watching the whole bus. */
+    if (mem->cart_snoop_read != NULL) {
+      (mem->cart_snoop_read)(mem->cart, address, value);
+    }
+    return value;
+  }
+
+  return 0;
+}
+
+
+
+uint8_t mem_peek(mem_t *mem, uint16_t address)
+{
+  mem_read_hook_t peek;
+  void *device;
+
+  /* Same as mem_read, but nothing is changed or synced, so the debugger
+     and tracer can look anywhere without disturbing the emulation. */
+  address &= 0x1FFF; /* Mirroring */
+
+  if ((address & 0x1000) > 0) { /* A12 = 1, Cartridge */
+    peek   = mem->cart_peek;
+    device = mem->cart;
+  } else if ((address & 0x80) > 0) { /* A7 = 1, PIA */
+    peek   = mem->pia_peek;
+    device = mem->pia;
+  } else { /* A7 = 0, TIA */
+    peek   = mem->tia_peek;
+    device = mem->tia;
   }
 
+  if (peek != NULL && device != NULL) {
+    return (peek)(device, address);
+  }
   return 0;
 }
 
@@ -84,6 +125,10 @@ void mem_write(mem_t *mem, uint16_t address, uint8_t value)
         panic("TIA write hook not installed! Address: 0x%04x\n", address);
       }
     }
+
+    if (mem->cart_snoop_write != NULL) {
+      (mem->cart_snoop_write)(mem->cart, address, value);
+    }
   }
 }
 
@@ -100,7 +145,7 @@ static void mem_dump_16(FILE *fh, mem_t *mem, uint16_t start, uint16_t end)
   for (i = 0; i < 16; i++) {
     address = (start & 0xFFF0) + i;
     if ((address >= start) && (address <= end)) {
-      fprintf(fh, "%02x ", mem_read(mem, address));
+      fprintf(fh, "%02x ", mem_peek(mem, address));
     } else {
       fprintf(fh, "   ");
     }
@@ -113,8 +158,8 @@ static void mem_dump_16(FILE *fh, mem_t *mem, uint16_t start, uint16_t end)
   for (i = 0; i < 16; i++) {
     address = (start & 0xFFF0) + i;
     if ((address >= start) && (address <= end)) {
-      if (isprint(mem_read(mem, address))) {
-        fprintf(fh, "%c", mem_read(mem, address));
+      if (isprint(mem_peek(mem, address))) {
+        fprintf(fh, "%c", mem_peek(mem, address));
       } else {
         fprintf(fh, ".");
       }
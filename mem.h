@@ -15,6 +15,11 @@ typedef struct mem_s {
   mem_write_hook_t pia_write;
   mem_read_hook_t  cart_read;
   mem_write_hook_t cart_write;
+  mem_write_hook_t cart_snoop_read; /* Optional, for TIA/PIA accesses. */
+  mem_write_hook_t cart_snoop_write;
+  mem_read_hook_t  tia_peek; /* Reads without side effects. */
+  mem_read_hook_t  pia_peek;
+  mem_read_hook_t  cart_peek;
   void *tia;
   void *pia;
   void *cart;
@@ -24,6 +29,7 @@ typedef struct mem_s {
 
 void mem_init(mem_t *mem);
 uint8_t mem_read(mem_t *mem, uint16_t address);
+uint8_t mem_peek(mem_t *mem, uint16_t address);
 void mem_write(mem_t *mem, uint16_t address, uint8_t value);
 void mem_dump(FILE *fh, mem_t *mem, uint16_t start, uint16_t end);
 
@@ -937,9 +937,13 @@ static void op_jmp_absi(mos6507_t *cpu, mem_t *mem)
 
 static void op_jsr(mos6507_t *cpu, mem_t *mem)
 {
-  OP_PROLOGUE_ABS
-  mem_write(mem, MEM_PAGE_STACK + cpu->sp--, (cpu->pc - 1) / 256);
-  mem_write(mem, MEM_PAGE_STACK + cpu->sp--, (cpu->pc - 1) % 256);
+  /* Same bus order as the real CPU, the high byte of the target is read
+     after the return address is pushed. FE cartridges depend on this. */
+  uint16_t absolute;
+  absolute = mem_read(mem, cpu->pc++);
+  mem_write(mem, MEM_PAGE_STACK + cpu->sp--, cpu->pc / 256);
+  mem_write(mem, MEM_PAGE_STACK + cpu->sp--, cpu->pc % 256);
+  absolute += mem_read(mem, cpu->pc) * 256;
   cpu->pc = absolute;
 }
 
@@ -0,0 +1,11 @@
+#ifndef _MOS6507_DISASM_H
+#define _MOS6507_DISASM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "mos6507.h"
+
+void mos6507_disassemble(FILE *fh, uint16_t pc, uint8_t mc[3]);
+void mos6507_register_dump(FILE *fh, mos6507_t *cpu, uint8_t mc[3]);
+
+#endif /* _MOS6507_DISASM_H */
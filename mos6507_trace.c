@@ -3,30 +3,20 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "mos6507.h"
+#include "mos6507_disasm.h"
+#include "mos6507_trace.h"
 #include "mem.h"
+#include "expr.h"
 
 
 
 #define MOS6507_TRACE_BUFFER_SIZE 20
-
-typedef enum {
-  AM_ACCU, /* A      - Accumulator */
-  AM_IMPL, /* i      - Implied */
-  AM_IMM,  /* #      - Immediate */
-  AM_ABS,  /* a      - Absolute */
-  AM_ABSI, /* (a)    - Indirect Absolute */
-  AM_ABSX, /* a,x    - Absolute + X */
-  AM_ABSY, /* a,y    - Absolute + Y */
-  AM_REL,  /* r      - Relative */
-  AM_ZP,   /* zp     - Zero Page */
-  AM_ZPX,  /* zp,x   - Zero Page + X */
-  AM_ZPY,  /* zp,y   - Zero Page + Y */
-  AM_ZPYI, /* (zp),y - Zero Page Indirect Indexed */
-  AM_ZPIX, /* (zp,x) - Zero Page Indexed Indirect */
-  AM_NONE,
-} mos6507_address_mode_t;
+#define MOS6507_TRACE_FILE_BUFFER_SIZE (MOS6507_TRACE_RECORD_SIZE * 0x8000)
 
 typedef struct mos6507_trace_s {
   mos6507_t cpu;
@@ -35,248 +25,297 @@ typedef struct mos6507_trace_s {
 
 
 
-static mos6507_address_mode_t opcode_address_mode[UINT8_MAX + 1] = {
-  AM_IMPL, AM_ZPIX, AM_NONE, AM_ZPIX, AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,
-  AM_IMPL, AM_IMM,  AM_ACCU, AM_IMM,  AM_ABS,  AM_ABS,  AM_ABS,  AM_ABS,
-  AM_REL,  AM_ZPYI, AM_NONE, AM_ZPYI, AM_ZPX,  AM_ZPX,  AM_ZPX,  AM_ZPX,
-  AM_IMPL, AM_ABSY, AM_IMPL, AM_ABSY, AM_ABSX, AM_ABSX, AM_ABSX, AM_ABSX,
-  AM_ABS,  AM_ZPIX, AM_NONE, AM_ZPIX, AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,
-  AM_IMPL, AM_IMM,  AM_ACCU, AM_IMM,  AM_ABS,  AM_ABS,  AM_ABS,  AM_ABS,
-  AM_REL,  AM_ZPYI, AM_NONE, AM_ZPYI, AM_ZPX,  AM_ZPX,  AM_ZPX,  AM_ZPX,
-  AM_IMPL, AM_ABSY, AM_IMPL, AM_ABSY, AM_ABSX, AM_ABSX, AM_ABSX, AM_ABSX,
-  AM_IMPL, AM_ZPIX, AM_NONE, AM_ZPIX, AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,
-  AM_IMPL, AM_IMM,  AM_ACCU, AM_IMM,  AM_ABS,  AM_ABS,  AM_ABS,  AM_ABS,
-  AM_REL,  AM_ZPYI, AM_NONE, AM_ZPYI, AM_ZPX,  AM_ZPX,  AM_ZPX,  AM_ZPX,
-  AM_IMPL, AM_ABSY, AM_IMPL, AM_ABSY, AM_ABSX, AM_ABSX, AM_ABSX, AM_ABSX,
-  AM_IMPL, AM_ZPIX, AM_NONE, AM_ZPIX, AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,
-  AM_IMPL, AM_IMM,  AM_ACCU, AM_IMM,  AM_ABSI, AM_ABS,  AM_ABS,  AM_ABS,
-  AM_REL,  AM_ZPYI, AM_NONE, AM_ZPYI, AM_ZPX,  AM_ZPX,  AM_ZPX,  AM_ZPX,
-  AM_IMPL, AM_ABSY, AM_IMPL, AM_ABSY, AM_ABSX, AM_ABSX, AM_ABSX, AM_ABSX,
-  AM_IMM,  AM_ZPIX, AM_IMM,  AM_ZPIX, AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,
-  AM_IMPL, AM_IMM,  AM_IMPL, AM_IMM,  AM_ABS,  AM_ABS,  AM_ABS,  AM_ABS,
-  AM_REL,  AM_ZPYI, AM_NONE, AM_ZPYI, AM_ZPX,  AM_ZPX,  AM_ZPY,  AM_ZPY,
-  AM_IMPL, AM_ABSY, AM_IMPL, AM_ABSY, AM_ABSX, AM_ABSX, AM_ABSY, AM_ABSY,
-  AM_IMM,  AM_ZPIX, AM_IMM,  AM_ZPIX, AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,
-  AM_IMPL, AM_IMM,  AM_IMPL, AM_IMM,  AM_ABS,  AM_ABS,  AM_ABS,  AM_ABS,
-  AM_REL,  AM_ZPYI, AM_NONE, AM_ZPYI, AM_ZPX,  AM_ZPX,  AM_ZPY,  AM_ZPY,
-  AM_IMPL, AM_ABSY, AM_IMPL, AM_ABSY, AM_ABSX, AM_ABSX, AM_ABSY, AM_ABSY,
-  AM_IMM,  AM_ZPIX, AM_IMM,  AM_ZPIX, AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,
-  AM_IMPL, AM_IMM,  AM_IMPL, AM_IMM,  AM_ABS,  AM_ABS,  AM_ABS,  AM_ABS,
-  AM_REL,  AM_ZPYI, AM_NONE, AM_ZPYI, AM_ZPX,  AM_ZPX,  AM_ZPX,  AM_ZPX,
-  AM_IMPL, AM_ABSY, AM_IMPL, AM_ABSY, AM_ABSX, AM_ABSX, AM_ABSX, AM_ABSX,
-  AM_IMM,  AM_ZPIX, AM_IMM,  AM_ZPIX, AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,
-  AM_IMPL, AM_IMM,  AM_IMPL, AM_IMM,  AM_ABS,  AM_ABS,  AM_ABS,  AM_ABS,
-  AM_REL,  AM_ZPYI, AM_NONE, AM_ZPYI, AM_ZPX,  AM_ZPX,  AM_ZPX,  AM_ZPX,
-  AM_IMPL, AM_ABSY, AM_IMPL, AM_ABSY, AM_ABSX, AM_ABSX, AM_ABSX, AM_ABSX,
-};
-
-
-
-static char *opcode_mnemonic[UINT8_MAX + 1] = {
-  "BRK", "ORA", "---", "SLO", "NOP", "ORA", "ASL", "SLO",
-  "PHP", "ORA", "ASL", "ANC", "NOP", "ORA", "ASL", "SLO",
-  "BPL", "ORA", "---", "SLO", "NOP", "ORA", "ASL", "SLO",
-  "CLC", "ORA", "NOP", "SLO", "NOP", "ORA", "ASL", "SLO",
-  "JSR", "AND", "---", "RLA", "BIT", "AND", "ROL", "RLA",
-  "PLP", "AND", "ROL", "ANC", "BIT", "AND", "ROL", "RLA",
-  "BMI", "AND", "---", "RLA", "NOP", "AND", "ROL", "RLA",
-  "SEC", "AND", "NOP", "RLA", "NOP", "AND", "ROL", "RLA",
-  "RTI", "EOR", "---", "SRE", "NOP", "EOR", "LSR", "SRE",
-  "PHA", "EOR", "LSR", "ALR", "JMP", "EOR", "LSR", "SRE",
-  "BVC", "EOR", "---", "SRE", "NOP", "EOR", "LSR", "SRE",
-  "CLI", "EOR", "NOP", "SRE", "NOP", "EOR", "LSR", "SRE",
-  "RTS", "ADC", "---", "RRA", "NOP", "ADC", "ROR", "RRA",
-  "PLA", "ADC", "ROR", "ARR", "JMP", "ADC", "ROR", "RRA",
-  "BVS", "ADC", "---", "RRA", "NOP", "ADC", "ROR", "RRA",
-  "SEI", "ADC", "NOP", "RRA", "NOP", "ADC", "ROR", "RRA",
-  "NOP", "STA", "NOP", "SAX", "STY", "STA", "STX", "SAX",
-  "DEY", "NOP", "TXA", "ANE", "STY", "STA", "STX", "SAX",
-  "BCC", "STA", "---", "SHA", "STY", "STA", "STX", "SAX",
-  "TYA", "STA", "TXS", "TAS", "SHY", "STA", "SHX", "SHA",
-  "LDY", "LDA", "LDX", "LAX", "LDY", "LDA", "LDX", "LAX",
-  "TAY", "LDA", "TAX", "LXA", "LDY", "LDA", "LDX", "LAX",
-  "BCS", "LDA", "---", "LAX", "LDY", "LDA", "LDX", "LAX",
-  "CLV", "LDA", "TSX", "LAS", "LDY", "LDA", "LDX", "LAX",
-  "CPY", "CMP", "NOP", "DCP", "CPY", "CMP", "DEC", "DCP",
-  "INY", "CMP", "DEX", "SBX", "CPY", "CMP", "DEC", "DCP",
-  "BNE", "CMP", "---", "DCP", "NOP", "CMP", "DEC", "DCP",
-  "CLD", "CMP", "NOP", "DCP", "NOP", "CMP", "DEC", "DCP",
-  "CPX", "SBC", "NOP", "ISC", "CPX", "SBC", "INC", "ISC",
-  "INX", "SBC", "NOP", "SBC", "CPX", "SBC", "INC", "ISC",
-  "BEQ", "SBC", "---", "ISC", "NOP", "SBC", "INC", "ISC",
-  "SED", "SBC", "NOP", "ISC", "NOP", "SBC", "INC", "ISC",
-};
+static mos6507_trace_t mos6507_trace_buffer[MOS6507_TRACE_BUFFER_SIZE];
+static int mos6507_trace_index = 0;
 
+/* The trace file is double buffered like TAS recording, with a writer
+   thread storing one buffer while instructions are added to the other. */
+static int mos6507_trace_fd = -1;
+static uint32_t mos6507_trace_depth = 0;
+static uint64_t mos6507_trace_count = 0;
+static uint8_t mos6507_trace_file_buffer[2][MOS6507_TRACE_FILE_BUFFER_SIZE];
+static size_t mos6507_trace_fill[2];
+static uint64_t mos6507_trace_start[2]; /* Number of first record. */
+static int mos6507_trace_current = 0;
+static bool mos6507_trace_pending = false;
+static bool mos6507_trace_quit = false;
+static pthread_t mos6507_trace_thread;
+static pthread_mutex_t mos6507_trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mos6507_trace_cond = PTHREAD_COND_INITIALIZER;
 
+/* Only instructions where the condition holds are traced, if one is set. */
+static expr_t mos6507_trace_filter;
+static bool mos6507_trace_filtered = false;
 
-static mos6507_trace_t mos6507_trace_buffer[MOS6507_TRACE_BUFFER_SIZE];
-static int mos6507_trace_index = 0;
 
 
+void mos6507_trace_init(void)
+{
+  memset(mos6507_trace_buffer, 0,
+    MOS6507_TRACE_BUFFER_SIZE * sizeof(mos6507_trace_t));
+}
 
-static void mos6507_disassemble(FILE *fh, uint16_t pc, uint8_t mc[3])
+
+
+void mos6507_trace_dump(FILE *fh)
 {
-  uint16_t address;
-  int8_t relative;
-
-  switch (opcode_address_mode[mc[0]]) {
-  case AM_ACCU:
-  case AM_IMPL:
-    fprintf(fh, "%02X          ", mc[0]);
-    break;
-
-  case AM_IMM:
-  case AM_REL:
-  case AM_ZP:
-  case AM_ZPX:
-  case AM_ZPY:
-  case AM_ZPYI:
-  case AM_ZPIX:
-    fprintf(fh, "%02X %02X       ", mc[0], mc[1]);
-    break;
-
-  case AM_ABS:
-  case AM_ABSI:
-  case AM_ABSX:
-  case AM_ABSY:
-    fprintf(fh, "%02X %02X %02X    ", mc[0], mc[1], mc[2]);
-    break;
-
-  case AM_NONE:
-  default:
-    fprintf(fh, "-           ");
-    break;
+  int i;
+
+  for (i = 0; i < MOS6507_TRACE_BUFFER_SIZE; i++) {
+    mos6507_trace_index++;
+    if (mos6507_trace_index >= MOS6507_TRACE_BUFFER_SIZE) {
+      mos6507_trace_index = 0;
+    }
+    mos6507_register_dump(fh, &mos6507_trace_buffer[mos6507_trace_index].cpu,
+                               mos6507_trace_buffer[mos6507_trace_index].mc);
   }
+}
+
+
 
-  fprintf(fh, "%s ", opcode_mnemonic[mc[0]]);
+void mos6507_trace_add(mos6507_t *cpu, mem_t *mem)
+{
+  uint8_t mc[3];
 
-  switch (opcode_address_mode[mc[0]]) {
-  case AM_ACCU:
-    fprintf(fh, "A       ");
-    break;
+  mos6507_trace_index++;
+  if (mos6507_trace_index >= MOS6507_TRACE_BUFFER_SIZE) {
+    mos6507_trace_index = 0;
+  }
 
-  case AM_IMPL:
-    fprintf(fh, "        ");
-    break;
+  memcpy(&mos6507_trace_buffer[mos6507_trace_index].cpu,
+    cpu, sizeof(mos6507_t));
+  mc[0] = mem_peek(mem, cpu->pc);
+  mc[1] = mem_peek(mem, cpu->pc + 1);
+  mc[2] = mem_peek(mem, cpu->pc + 2);
+  memcpy(&mos6507_trace_buffer[mos6507_trace_index].mc,
+    mc, sizeof(uint8_t) * 3);
+}
 
-  case AM_IMM:
-    fprintf(fh, "#$%02X    ", mc[1]);
-    break;
 
-  case AM_ABS:
-    fprintf(fh, "$%02X%02X   ", mc[2], mc[1]);
-    break;
 
-  case AM_ABSI:
-    fprintf(fh, "($%02X%02X) ", mc[2], mc[1]);
-    break;
+static void mos6507_trace_put16(uint8_t *p, uint16_t value)
+{
+  p[0] = value;
+  p[1] = value >> 8;
+}
 
-  case AM_ABSX:
-    fprintf(fh, "$%02X%02X,X ", mc[2], mc[1]);
-    break;
 
-  case AM_ABSY:
-    fprintf(fh, "$%02X%02X,Y ", mc[2], mc[1]);
-    break;
 
-  case AM_REL:
-    address = pc + 2;
-    relative = mc[1];
-    address += relative;
-    fprintf(fh, "$%04X   ", address);
-    break;
+static void mos6507_trace_put32(uint8_t *p, uint32_t value)
+{
+  mos6507_trace_put16(&p[0], value);
+  mos6507_trace_put16(&p[2], value >> 16);
+}
 
-  case AM_ZP:
-    fprintf(fh, "$%02X     ", mc[1]);
-    break;
 
-  case AM_ZPX:
-    fprintf(fh, "$%02X,X   ", mc[1]);
-    break;
 
-  case AM_ZPY:
-    fprintf(fh, "$%02X,Y   ", mc[1]);
-    break;
+static void mos6507_trace_put64(uint8_t *p, uint64_t value)
+{
+  mos6507_trace_put32(&p[0], value);
+  mos6507_trace_put32(&p[4], value >> 32);
+}
 
-  case AM_ZPYI:
-    fprintf(fh, "($%02X),Y ", mc[1]);
-    break;
 
-  case AM_ZPIX:
-    fprintf(fh, "($%02X,X) ", mc[1]);
-    break;
 
-  case AM_NONE:
-  default:
-    fprintf(fh, "-       ");
-    break;
+static void mos6507_trace_file_write(int index)
+{
+  const uint8_t *data = mos6507_trace_file_buffer[index];
+  uint64_t record = mos6507_trace_start[index];
+  size_t count = mos6507_trace_fill[index] / MOS6507_TRACE_RECORD_SIZE;
+  size_t chunk;
+  uint64_t slot;
+
+  /* Wrap around the end of the ring as needed. Later records overwrite
+     earlier ones if the buffer holds more than the whole ring. */
+  while (count > 0) {
+    chunk = count;
+    slot = record;
+    if (mos6507_trace_depth > 0) {
+      slot = record % mos6507_trace_depth;
+      if (chunk > mos6507_trace_depth - slot) {
+        chunk = mos6507_trace_depth - slot;
+      }
+    }
+    if (pwrite(mos6507_trace_fd, data, chunk * MOS6507_TRACE_RECORD_SIZE,
+      MOS6507_TRACE_HEADER_SIZE + (slot * MOS6507_TRACE_RECORD_SIZE)) < 0) {
+      return;
+    }
+    data += chunk * MOS6507_TRACE_RECORD_SIZE;
+    record += chunk;
+    count -= chunk;
   }
 }
 
 
 
-static void mos6507_register_dump(FILE *fh, mos6507_t *cpu, uint8_t mc[3])
+static void *mos6507_trace_writer(void *arg)
 {
-  fprintf(fh, ".C:%04x  ", cpu->pc);
-  mos6507_disassemble(fh, cpu->pc, mc);
-  fprintf(fh, "   - ");
-  fprintf(fh, "A:%02X ", cpu->a);
-  fprintf(fh, "X:%02X ", cpu->x);
-  fprintf(fh, "Y:%02X ", cpu->y);
-  fprintf(fh, "SP:%02x ", cpu->sp);
-  fprintf(fh, "%c", (cpu->sr.n) ? 'N' : '.');
-  fprintf(fh, "%c", (cpu->sr.v) ? 'V' : '.');
-  fprintf(fh, "-");
-  fprintf(fh, "%c", (cpu->sr.b) ? 'B' : '.');
-  fprintf(fh, "%c", (cpu->sr.d) ? 'D' : '.');
-  fprintf(fh, "%c", (cpu->sr.i) ? 'I' : '.');
-  fprintf(fh, "%c", (cpu->sr.z) ? 'Z' : '.');
-  fprintf(fh, "%c", (cpu->sr.c) ? 'C' : '.');
-  fprintf(fh, "\n");
+  (void)arg;
+  pthread_mutex_lock(&mos6507_trace_mutex);
+  while (1) {
+    while (! mos6507_trace_pending && ! mos6507_trace_quit) {
+      pthread_cond_wait(&mos6507_trace_cond, &mos6507_trace_mutex);
+    }
+    if (! mos6507_trace_pending) {
+      break;
+    }
+    pthread_mutex_unlock(&mos6507_trace_mutex);
+
+    mos6507_trace_file_write(mos6507_trace_current ^ 1);
+
+    pthread_mutex_lock(&mos6507_trace_mutex);
+    mos6507_trace_pending = false;
+    pthread_cond_broadcast(&mos6507_trace_cond);
+  }
+  pthread_mutex_unlock(&mos6507_trace_mutex);
+
+  return NULL;
 }
 
 
 
-void mos6507_trace_init(void)
+static void mos6507_trace_swap(void)
 {
-  memset(mos6507_trace_buffer, 0,
-    MOS6507_TRACE_BUFFER_SIZE * sizeof(mos6507_trace_t));
+  pthread_mutex_lock(&mos6507_trace_mutex);
+  while (mos6507_trace_pending) { /* Only waits if the disk falls behind. */
+    pthread_cond_wait(&mos6507_trace_cond, &mos6507_trace_mutex);
+  }
+  mos6507_trace_current ^= 1;
+  mos6507_trace_fill[mos6507_trace_current] = 0;
+  mos6507_trace_start[mos6507_trace_current] = mos6507_trace_count;
+  mos6507_trace_pending = true;
+  pthread_cond_broadcast(&mos6507_trace_cond);
+  pthread_mutex_unlock(&mos6507_trace_mutex);
 }
 
 
 
-void mos6507_trace_dump(FILE *fh)
+static int mos6507_trace_header_write(void)
 {
-  int i;
+  uint8_t header[MOS6507_TRACE_HEADER_SIZE];
+
+  memset(header, 0, MOS6507_TRACE_HEADER_SIZE);
+  memcpy(header, MOS6507_TRACE_MAGIC, MOS6507_TRACE_MAGIC_SIZE);
+  header[MOS6507_TRACE_MAGIC_SIZE] = MOS6507_TRACE_VERSION;
+  mos6507_trace_put32(&header[MOS6507_TRACE_HEADER_DEPTH],
+    mos6507_trace_depth);
+  mos6507_trace_put64(&header[MOS6507_TRACE_HEADER_COUNT],
+    mos6507_trace_count);
+
+  if (pwrite(mos6507_trace_fd, header, MOS6507_TRACE_HEADER_SIZE, 0) !=
+    MOS6507_TRACE_HEADER_SIZE) {
+    return -1;
+  }
+  return 0;
+}
 
-  for (i = 0; i < MOS6507_TRACE_BUFFER_SIZE; i++) {
-    mos6507_trace_index++;
-    if (mos6507_trace_index >= MOS6507_TRACE_BUFFER_SIZE) {
-      mos6507_trace_index = 0;
-    }
-    mos6507_register_dump(fh, &mos6507_trace_buffer[mos6507_trace_index].cpu,
-                               mos6507_trace_buffer[mos6507_trace_index].mc);
+
+
+static void mos6507_trace_file_exit(void)
+{
+  if (mos6507_trace_fd == -1) {
+    return;
+  }
+
+  if (mos6507_trace_fill[mos6507_trace_current] > 0) {
+    mos6507_trace_swap();
   }
+
+  pthread_mutex_lock(&mos6507_trace_mutex);
+  mos6507_trace_quit = true;
+  pthread_cond_broadcast(&mos6507_trace_cond);
+  pthread_mutex_unlock(&mos6507_trace_mutex);
+  pthread_join(mos6507_trace_thread, NULL);
+
+  mos6507_trace_header_write(); /* Count is only known now. */
+  close(mos6507_trace_fd);
+  mos6507_trace_fd = -1;
 }
 
 
 
-void mos6507_trace_add(mos6507_t *cpu, mem_t *mem)
+int mos6507_trace_file_init(const char *filename, uint32_t depth,
+  const expr_t *cond)
 {
-  uint8_t mc[3];
+  mos6507_trace_fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (mos6507_trace_fd == -1) {
+    return -1;
+  }
 
-  mos6507_trace_index++;
-  if (mos6507_trace_index >= MOS6507_TRACE_BUFFER_SIZE) {
-    mos6507_trace_index = 0;
+  mos6507_trace_depth = depth;
+  mos6507_trace_filtered = (cond != NULL);
+  if (cond != NULL) {
+    mos6507_trace_filter = *cond;
+  }
+  mos6507_trace_count = 0;
+  mos6507_trace_current = 0;
+  mos6507_trace_fill[0] = 0;
+  mos6507_trace_start[0] = 0;
+  mos6507_trace_pending = false;
+  mos6507_trace_quit = false;
+
+  if (mos6507_trace_header_write() != 0 ||
+    pthread_create(&mos6507_trace_thread, NULL, mos6507_trace_writer,
+    NULL) != 0) {
+    close(mos6507_trace_fd);
+    mos6507_trace_fd = -1;
+    return -1;
   }
+  atexit(mos6507_trace_file_exit);
 
-  memcpy(&mos6507_trace_buffer[mos6507_trace_index].cpu,
-    cpu, sizeof(mos6507_t));
-  mc[0] = mem_read(mem, cpu->pc);
-  mc[1] = mem_read(mem, cpu->pc + 1);
-  mc[2] = mem_read(mem, cpu->pc + 2);
-  memcpy(&mos6507_trace_buffer[mos6507_trace_index].mc,
-    mc, sizeof(uint8_t) * 3);
+  return 0;
+}
+
+
+
+void mos6507_trace_file_add(mos6507_t *cpu, mem_t *mem,
+  mos6507_trace_where_t *where)
+{
+  expr_env_t env;
+  uint8_t *record;
+  int i;
+
+  if (mos6507_trace_filtered) {
+    env.cpu      = cpu;
+    env.mem      = mem;
+    env.frame    = where->frame;
+    env.scanline = where->scanline;
+    env.dot      = where->dot;
+    if (expr_eval(&mos6507_trace_filter, &env) == 0) {
+      return;
+    }
+  }
+
+  if (mos6507_trace_fill[mos6507_trace_current] +
+    MOS6507_TRACE_RECORD_SIZE > MOS6507_TRACE_FILE_BUFFER_SIZE) {
+    mos6507_trace_swap();
+  }
+  record = &mos6507_trace_file_buffer[mos6507_trace_current]
+                                     [mos6507_trace_fill[mos6507_trace_current]];
+  memset(record, 0, MOS6507_TRACE_RECORD_SIZE);
+
+  mos6507_trace_put64(&record[MOS6507_TRACE_RECORD_CYCLE], where->cycle);
+  mos6507_trace_put32(&record[MOS6507_TRACE_RECORD_FRAME], where->frame);
+  mos6507_trace_put16(&record[MOS6507_TRACE_RECORD_SCANLINE],
+    where->scanline);
+  record[MOS6507_TRACE_RECORD_DOT] = where->dot;
+  record[MOS6507_TRACE_RECORD_SR] = (cpu->sr.n << 7) | (cpu->sr.v << 6) |
+    (1 << 5) | (cpu->sr.b << 4) | (cpu->sr.d << 3) | (cpu->sr.i << 2) |
+    (cpu->sr.z << 1) | cpu->sr.c;
+  mos6507_trace_put16(&record[MOS6507_TRACE_RECORD_PC], cpu->pc);
+  for (i = 0; i < 3; i++) {
+    record[MOS6507_TRACE_RECORD_MC + i] = mem_peek(mem, cpu->pc + i);
+  }
+  record[MOS6507_TRACE_RECORD_A] = cpu->a;
+  record[MOS6507_TRACE_RECORD_X] = cpu->x;
+  record[MOS6507_TRACE_RECORD_Y] = cpu->y;
+  record[MOS6507_TRACE_RECORD_SP] = cpu->sp;
+  for (i = 0; i < MOS6507_TRACE_BANKS; i++) {
+    record[MOS6507_TRACE_RECORD_BANK + i] = where->bank[i];
+  }
+
+  mos6507_trace_fill[mos6507_trace_current] += MOS6507_TRACE_RECORD_SIZE;
+  mos6507_trace_count++;
 }
 
 
@@ -2,11 +2,51 @@
 #define _MOS6507_TRACE_H
 
 #include <stdio.h>
+#include <stdint.h>
 #include "mos6507.h"
 #include "mem.h"
+#include "expr.h"
+
+/* Trace file: A header of magic, version, depth (0 = unlimited) and count
+   of instructions traced, then records in little endian. With a depth the
+   records form a ring, with instruction N stored at N % depth. */
+#define MOS6507_TRACE_MAGIC "A26I"
+#define MOS6507_TRACE_MAGIC_SIZE 4
+#define MOS6507_TRACE_VERSION 1
+#define MOS6507_TRACE_HEADER_SIZE 24
+#define MOS6507_TRACE_HEADER_DEPTH 8
+#define MOS6507_TRACE_HEADER_COUNT 16
+
+#define MOS6507_TRACE_RECORD_SIZE 32
+#define MOS6507_TRACE_RECORD_CYCLE    0  /* 64 bits */
+#define MOS6507_TRACE_RECORD_FRAME    8  /* 32 bits */
+#define MOS6507_TRACE_RECORD_SCANLINE 12 /* 16 bits */
+#define MOS6507_TRACE_RECORD_DOT      14
+#define MOS6507_TRACE_RECORD_SR       15 /* NV-BDIZC */
+#define MOS6507_TRACE_RECORD_PC       16 /* 16 bits */
+#define MOS6507_TRACE_RECORD_MC       18 /* 3 bytes */
+#define MOS6507_TRACE_RECORD_A        21
+#define MOS6507_TRACE_RECORD_X        22
+#define MOS6507_TRACE_RECORD_Y        23
+#define MOS6507_TRACE_RECORD_SP       24
+#define MOS6507_TRACE_RECORD_BANK     25 /* 4 bytes */
+
+#define MOS6507_TRACE_BANKS 4
+
+typedef struct mos6507_trace_where_s {
+  uint64_t cycle;
+  uint32_t frame;
+  uint16_t scanline;
+  uint8_t dot;
+  uint8_t bank[MOS6507_TRACE_BANKS];
+} mos6507_trace_where_t;
 
 void mos6507_trace_init(void);
 void mos6507_trace_add(mos6507_t *cpu, mem_t *mem);
 void mos6507_trace_dump(FILE *fh);
+int mos6507_trace_file_init(const char *filename, uint32_t depth,
+  const expr_t *cond);
+void mos6507_trace_file_add(mos6507_t *cpu, mem_t *mem,
+  mos6507_trace_where_t *where);
 
 #endif /* _MOS6507_TRACE_H */
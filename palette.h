@@ -0,0 +1,10 @@
+#ifndef _PALETTE_H
+#define _PALETTE_H
+
+#include <stdint.h>
+
+#define PALETTE_COLORS 128
+
+extern const uint8_t palette_rgb[PALETTE_COLORS][3];
+
+#endif /* _PALETTE_H */
@@ -6,43 +6,100 @@
 
 #include "pia.h"
 #include "mem.h"
-#include "gui.h"
-#include "console.h"
-#include "tas.h"
+#include "input.h"
 #include "main.h"
 
 
 
-static uint8_t pia_read_hook(void *pia, uint16_t address)
+static void pia_timer_update(pia_t *pia)
+{
+  uint64_t elapsed, period, ticks;
+
+  /* Catch up on the cycles run since the last access, giving the same
+     result as counting them one at a time: The timer decrements when the
+     cycle count passes the interval, and on every cycle after underflow. */
+  elapsed = pia->clock - pia->timer_clock;
+  pia->timer_clock = pia->clock;
+
+  if (! pia->underflow) {
+    period = pia->interval + 1;
+    if (elapsed < period - pia->cycle) {
+      pia->cycle += elapsed;
+      return;
+    }
+    elapsed -= period - pia->cycle;
+    ticks = 1 + (elapsed / period);
+    if (ticks <= pia->timer) {
+      pia->timer -= ticks;
+      pia->cycle = elapsed % period;
+      return;
+    }
+    elapsed -= pia->timer * period;
+    pia->timer = 0xFF;
+    pia->underflow = true;
+    pia->cycle = 0;
+  }
+
+  pia->timer -= elapsed;
+}
+
+
+
+static void pia_port_update(pia_t *pia)
+{
+  uint8_t keep;
+
+  /* Keep the existing value on the bit if it is an output. */
+  keep = pia->port_a & pia->port_a_ddr;
+  pia->port_a = input_get_joystick_movement() | keep;
+
+  keep = pia->port_b & pia->port_b_ddr;
+  pia->port_b = input_get_system_switches() | keep;
+}
+
+
+
+uint8_t pia_timer(pia_t *pia)
+{
+  /* The value INTIM reads now, without the reset of underflow. */
+  pia_timer_update(pia);
+  return pia->timer;
+}
+
+
+
+static uint8_t pia_peek_hook(void *pia, uint16_t address)
 {
   if ((address & 0x200) > 0) { /* I/O */
     address &= 0x287; /* Mirroring */
 
     switch (address) {
-    case PIA_SWCHA:
-      return ((pia_t *)pia)->port_a;
+    case PIA_SWCHA: /* Input on the bits that are not outputs. */
+      return input_get_joystick_movement() |
+             (((pia_t *)pia)->port_a & ((pia_t *)pia)->port_a_ddr);
 
     case PIA_SWACNT:
       return ((pia_t *)pia)->port_a_ddr;
 
     case PIA_SWCHB:
-      return ((pia_t *)pia)->port_b;
+      return input_get_system_switches() |
+             (((pia_t *)pia)->port_b & ((pia_t *)pia)->port_b_ddr);
 
     case PIA_SWBCNT:
       return ((pia_t *)pia)->port_b_ddr;
 
     case PIA_INTIM:
     case PIA_INTIM_COPY:
-      ((pia_t *)pia)->underflow = false; /* Reset on read! */
-      return ((pia_t *)pia)->timer;
+      return pia_timer(pia);
 
     case PIA_INSTAT:
     case PIA_INSTAT_COPY:
-      /* Not implemented. */
-      return 0;
+      /* Bit 7 is the timer interrupt flag, bit 6 the PA7 edge detect flag,
+         which is never set since edge detection is not used. */
+      pia_timer_update(pia);
+      return ((pia_t *)pia)->underflow ? 0x80 : 0;
 
     default:
-      panic("PIA I/O read on unhandled address: 0x%04x\n", address);
       return 0;
     }
 
@@ -53,6 +110,40 @@ static uint8_t pia_read_hook(void *pia, uint16_t address)
 
 
 
+static uint8_t pia_read_hook(void *pia, uint16_t address)
+{
+  uint8_t value;
+
+  value = pia_peek_hook(pia, address);
+
+  if ((address & 0x200) > 0) { /* I/O */
+    address &= 0x287; /* Mirroring */
+
+    switch (address) {
+    case PIA_SWCHA:
+    case PIA_SWACNT:
+    case PIA_SWCHB:
+    case PIA_SWBCNT:
+    case PIA_INSTAT:
+    case PIA_INSTAT_COPY:
+      break;
+
+    case PIA_INTIM:
+    case PIA_INTIM_COPY:
+      ((pia_t *)pia)->underflow = false; /* Reset on read! */
+      break;
+
+    default:
+      panic("PIA I/O read on unhandled address: 0x%04x\n", address);
+      return 0;
+    }
+  }
+
+  return value;
+}
+
+
+
 static void pia_write_hook(void *pia, uint16_t address, uint8_t value)
 {
   if ((address & 0x200) > 0) { /* I/O */
@@ -80,6 +171,7 @@ static void pia_write_hook(void *pia, uint16_t address, uint8_t value)
       ((pia_t *)pia)->timer = value - 1;
       ((pia_t *)pia)->cycle = 0;
       ((pia_t *)pia)->underflow = false;
+      ((pia_t *)pia)->timer_clock = ((pia_t *)pia)->clock;
       break;
 
     case PIA_TIM8T:
@@ -87,6 +179,7 @@ static void pia_write_hook(void *pia, uint16_t address, uint8_t value)
       ((pia_t *)pia)->timer = value - 1;
       ((pia_t *)pia)->cycle = 0;
       ((pia_t *)pia)->underflow = false;
+      ((pia_t *)pia)->timer_clock = ((pia_t *)pia)->clock;
       break;
 
     case PIA_TIM64T:
@@ -94,6 +187,7 @@ static void pia_write_hook(void *pia, uint16_t address, uint8_t value)
       ((pia_t *)pia)->timer = value - 1;
       ((pia_t *)pia)->cycle = 0;
       ((pia_t *)pia)->underflow = false;
+      ((pia_t *)pia)->timer_clock = ((pia_t *)pia)->clock;
       break;
 
     case PIA_T1024T:
@@ -101,6 +195,7 @@ static void pia_write_hook(void *pia, uint16_t address, uint8_t value)
       ((pia_t *)pia)->timer = value - 1;
       ((pia_t *)pia)->cycle = 0;
       ((pia_t *)pia)->underflow = false;
+      ((pia_t *)pia)->timer_clock = ((pia_t *)pia)->clock;
       break;
 
     default:
@@ -122,6 +217,7 @@ void pia_init(pia_t *pia, mem_t *mem)
   mem->pia = pia;
   mem->pia_read  = pia_read_hook;
   mem->pia_write = pia_write_hook;
+  mem->pia_peek  = pia_peek_hook;
 
   for (i = 0; i < PIA_RAM_SIZE; i++) {
     pia->ram[i] = 0xFF;
@@ -136,42 +232,18 @@ void pia_init(pia_t *pia, mem_t *mem)
   pia->interval  = 1024;
   pia->cycle     = 0;
   pia->underflow = false;
+
+  pia->clock       = 0;
+  pia->timer_clock = 0;
 }
 
 
 
-void pia_execute(pia_t *pia)
+void pia_update(pia_t *pia)
 {
-  uint8_t keep;
-
-  pia->cycle++;
-  if (pia->cycle > pia->interval || pia->underflow) {
-    pia->cycle = 0;
-    pia->timer--;
-    if (pia->timer == 0xFF) {
-      /* Timer decrements every clock cycle if timer underflows. */
-      pia->underflow = true;
-    }
-  }
-
-  /* Keep the existing value on the bit if it is an output. */
-  keep = pia->port_a & pia->port_a_ddr;
-  if (tas_is_active()) {
-    pia->port_a = tas_get_joystick_movement();
-  } else {
-    pia->port_a = gui_get_joystick_movement() &
-                  console_get_joystick_movement();
-  }
-  pia->port_a |= keep;
-
-  keep = pia->port_b & pia->port_b_ddr;
-  if (tas_is_active()) {
-    pia->port_b = tas_get_system_switches();
-  } else {
-    pia->port_b = gui_get_system_switches() &
-                  console_get_system_switches();
-  }
-  pia->port_b |= keep;
+  /* Bring everything normally worked out on access up to date. */
+  pia_timer_update(pia);
+  pia_port_update(pia);
 }
 
 
@@ -190,6 +262,7 @@ static void pia_port_dump(FILE *fh, uint8_t value, uint8_t ddr)
 
 void pia_dump(FILE *fh, pia_t *pia)
 {
+  pia_update(pia);
   fprintf(fh, "Port A:\n");
   pia_port_dump(fh, pia->port_a, pia->port_a_ddr);
   fprintf(fh, "Port B:\n");
@@ -20,6 +20,9 @@ typedef struct pia_s {
   uint16_t interval;
   uint16_t cycle;
   bool underflow;
+
+  uint64_t clock; /* CPU cycles run, advanced by sync(). */
+  uint64_t timer_clock; /* Clock value the timer fields are valid at. */
 } pia_t;
 
 #define PIA_SWCHA        0x280 /* Port A */
@@ -36,7 +39,8 @@ typedef struct pia_s {
 #define PIA_T1024T       0x287 /* Timer 1024 Clock Interval */
 
 void pia_init(pia_t *pia, mem_t *mem);
-void pia_execute(pia_t *pia);
+void pia_update(pia_t *pia);
+uint8_t pia_timer(pia_t *pia);
 void pia_dump(FILE *fh, pia_t *pia);
 
 #endif /* _PIA_H */
@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "reverse.h"
+#include "state.h"
+#include "input.h"
+#include "mos6507.h"
+#include "mem.h"
+#include "pia.h"
+
+
+
+#define REVERSE_SNAPSHOTS 128
+#define REVERSE_INTERVAL 16384 /* CPU cycles, a bit less than a frame. */
+#define REVERSE_FRAMES 256
+
+typedef struct reverse_snapshot_s {
+  uint64_t clock;
+  uint32_t frame;
+  bool redraw_done;
+  size_t size;
+  uint8_t state[STATE_SIZE_MAX];
+} reverse_snapshot_t;
+
+typedef struct reverse_input_s {
+  uint32_t frame;
+  bool valid;
+  uint8_t system_switches;
+  uint8_t joystick_movement;
+  bool joystick_button_p0;
+  bool joystick_button_p1;
+} reverse_input_t;
+
+/* Snapshots are taken by the PIA clock, which counts CPU cycles and is not
+   affected by idle loop skipping, so any earlier instruction boundary can be
+   reached again by loading the snapshot before it and running forward. To
+   make that deterministic, the input latched for each frame is logged, and
+   frames already seen get the same input when run again. */
+static reverse_snapshot_t reverse_snapshot[REVERSE_SNAPSHOTS];
+static int reverse_first;
+static int reverse_count;
+
+static reverse_input_t reverse_input[REVERSE_FRAMES];
+static bool reverse_input_seen;
+static uint32_t reverse_input_latest;
+
+
+
+void reverse_init(void)
+{
+  int i;
+
+  reverse_first = 0;
+  reverse_count = 0;
+  for (i = 0; i < REVERSE_FRAMES; i++) {
+    reverse_input[i].valid = false;
+  }
+  reverse_input_seen = false;
+  reverse_input_latest = 0;
+}
+
+
+
+static inline int reverse_index(int n)
+{
+  return (reverse_first + n) % REVERSE_SNAPSHOTS;
+}
+
+
+
+uint64_t reverse_capture(mos6507_t *cpu, mem_t *mem, uint32_t frame,
+  bool redraw_done)
+{
+  reverse_snapshot_t *snapshot;
+
+  if (reverse_count == REVERSE_SNAPSHOTS) {
+    reverse_first = (reverse_first + 1) % REVERSE_SNAPSHOTS;
+    reverse_count--;
+  }
+  snapshot = &reverse_snapshot[reverse_index(reverse_count)];
+  reverse_count++;
+
+  snapshot->clock = ((pia_t *)mem->pia)->clock;
+  snapshot->frame = frame;
+  snapshot->redraw_done = redraw_done;
+  snapshot->size = state_save(snapshot->state, cpu, mem);
+
+  /* Clock value to take the next snapshot at. */
+  return snapshot->clock + REVERSE_INTERVAL;
+}
+
+
+
+int reverse_restore(uint64_t before, mos6507_t *cpu, mem_t *mem,
+  uint32_t *frame, bool *redraw_done)
+{
+  reverse_snapshot_t *snapshot;
+  int n;
+
+  /* Load the newest snapshot taken before the clock value given, and
+     forget the ones after it, since they will be taken again. */
+  for (n = reverse_count - 1; n >= 0; n--) {
+    snapshot = &reverse_snapshot[reverse_index(n)];
+    if (snapshot->clock < before) {
+      break;
+    }
+  }
+  if (n < 0) {
+    return -1;
+  }
+
+  ((pia_t *)mem->pia)->clock = snapshot->clock;
+  if (state_load(snapshot->state, snapshot->size, cpu, mem) != 0) {
+    return -1;
+  }
+  reverse_count = n + 1;
+  *frame = snapshot->frame;
+  *redraw_done = snapshot->redraw_done;
+  reverse_replay_input(snapshot->frame);
+  return 0;
+}
+
+
+
+void reverse_record_input(uint32_t frame)
+{
+  reverse_input_t *input;
+
+  input = &reverse_input[frame % REVERSE_FRAMES];
+  input->frame              = frame;
+  input->valid              = true;
+  input->system_switches    = input_get_system_switches();
+  input->joystick_movement  = input_get_joystick_movement();
+  input->joystick_button_p0 = input_get_joystick_button_p0();
+  input->joystick_button_p1 = input_get_joystick_button_p1();
+
+  reverse_input_latest = frame;
+  reverse_input_seen = true;
+}
+
+
+
+bool reverse_replay_input(uint32_t frame)
+{
+  reverse_input_t *input;
+
+  /* Only frames up to the newest one seen, else the input is live. */
+  if (! reverse_input_seen || frame > reverse_input_latest) {
+    return false;
+  }
+  input = &reverse_input[frame % REVERSE_FRAMES];
+  if (! input->valid || input->frame != frame) {
+    return false;
+  }
+
+  input_set(input->system_switches, input->joystick_movement,
+    input->joystick_button_p0, input->joystick_button_p1);
+  return true;
+}
+
+
+
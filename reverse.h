@@ -0,0 +1,17 @@
+#ifndef _REVERSE_H
+#define _REVERSE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mos6507.h"
+#include "mem.h"
+
+void reverse_init(void);
+uint64_t reverse_capture(mos6507_t *cpu, mem_t *mem, uint32_t frame,
+  bool redraw_done);
+int reverse_restore(uint64_t before, mos6507_t *cpu, mem_t *mem,
+  uint32_t *frame, bool *redraw_done);
+void reverse_record_input(uint32_t frame);
+bool reverse_replay_input(uint32_t frame);
+
+#endif /* _REVERSE_H */
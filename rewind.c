@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "rewind.h"
+#include "state.h"
+#include "mos6507.h"
+#include "mem.h"
+
+
+
+#define REWIND_FRAMES 1800 /* 30 seconds at 60 Hz. */
+#define REWIND_KEYFRAME_INTERVAL 60
+#define REWIND_BUFFER_SIZE 0x40000
+#define REWIND_DELTA_MAX (STATE_SIZE_MAX * 2)
+
+typedef struct rewind_record_s {
+  uint32_t offset;
+  uint16_t size;
+  bool keyframe;
+} rewind_record_t;
+
+/* Records are kept in a byte ring, a keyframe holds a raw state and the
+   following frames hold the XOR difference against it, run-length encoded.
+   The oldest records are dropped a keyframe group at a time. */
+static uint8_t rewind_buffer[REWIND_BUFFER_SIZE];
+static rewind_record_t rewind_record[REWIND_FRAMES];
+static int rewind_first;
+static int rewind_count;
+static uint32_t rewind_write;
+
+static uint8_t rewind_keyframe[STATE_SIZE_MAX];
+static size_t rewind_keyframe_size;
+static int rewind_keyframe_age;
+
+
+
+void rewind_init(void)
+{
+  rewind_first = 0;
+  rewind_count = 0;
+  rewind_write = 0;
+  rewind_keyframe_size = 0;
+  rewind_keyframe_age = 0;
+}
+
+
+
+static size_t rewind_rle_encode(uint8_t out[], const uint8_t in[], size_t size)
+{
+  size_t i, n, start;
+
+  /* Pairs of (zero count, literal count) followed by the literals. */
+  i = 0;
+  n = 0;
+  while (i < size) {
+    start = i;
+    while (i < size && in[i] == 0 && i - start < UINT8_MAX) {
+      i++;
+    }
+    out[n++] = i - start;
+
+    start = i;
+    while (i < size && in[i] != 0 && i - start < UINT8_MAX) {
+      i++;
+    }
+    out[n++] = i - start;
+    memcpy(&out[n], &in[start], i - start);
+    n += i - start;
+  }
+
+  return n;
+}
+
+
+
+static void rewind_rle_decode_xor(uint8_t state[], size_t state_size,
+  const uint8_t in[], size_t size)
+{
+  size_t i, n, j;
+
+  i = 0;
+  n = 0;
+  while (n + 1 < size) {
+    i += in[n++]; /* Zeroes leave the keyframe as is. */
+    j = in[n++];
+    while (j > 0 && i < state_size && n < size) {
+      state[i++] ^= in[n++];
+      j--;
+    }
+  }
+}
+
+
+
+static inline int rewind_index(int n)
+{
+  return (rewind_first + n) % REWIND_FRAMES;
+}
+
+
+
+static void rewind_drop_oldest(void)
+{
+  /* Drop a whole keyframe group, since the deltas depend on it. */
+  do {
+    rewind_first = (rewind_first + 1) % REWIND_FRAMES;
+    rewind_count--;
+  } while (rewind_count > 0 && ! rewind_record[rewind_first].keyframe);
+}
+
+
+
+static bool rewind_overlaps(uint32_t offset, size_t size)
+{
+  rewind_record_t *record;
+  int i;
+
+  for (i = 0; i < rewind_count; i++) {
+    record = &rewind_record[rewind_index(i)];
+    if (record->offset < offset + size &&
+        record->offset + record->size > offset) {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+
+static void rewind_store(const uint8_t data[], size_t size, bool keyframe)
+{
+  rewind_record_t *record;
+
+  if (rewind_write + size > REWIND_BUFFER_SIZE) {
+    rewind_write = 0;
+  }
+
+  /* Any record in the way must go, not just the oldest. After a wrap the
+     oldest can be in the unused tail while newer ones are at the start.
+     Dropping from the oldest keeps the keyframe groups whole. */
+  while (rewind_count > 0 &&
+         (rewind_count >= REWIND_FRAMES ||
+          rewind_overlaps(rewind_write, size))) {
+    rewind_drop_oldest();
+  }
+
+  record = &rewind_record[rewind_index(rewind_count)];
+  record->offset = rewind_write;
+  record->size = size;
+  record->keyframe = keyframe;
+  memcpy(&rewind_buffer[rewind_write], data, size);
+  rewind_write += size;
+  rewind_count++;
+}
+
+
+
+void rewind_capture(mos6507_t *cpu, mem_t *mem)
+{
+  uint8_t state[STATE_SIZE_MAX];
+  uint8_t delta[REWIND_DELTA_MAX];
+  size_t size;
+  size_t i;
+
+  size = state_save(state, cpu, mem);
+
+  if (rewind_keyframe_age == 0 || size != rewind_keyframe_size ||
+      rewind_count == 0) {
+    memcpy(rewind_keyframe, state, size);
+    rewind_keyframe_size = size;
+    rewind_store(state, size, true);
+
+  } else {
+    for (i = 0; i < size; i++) {
+      state[i] ^= rewind_keyframe[i];
+    }
+    rewind_store(delta, rewind_rle_encode(delta, state, size), false);
+  }
+
+  rewind_keyframe_age = (rewind_keyframe_age + 1) % REWIND_KEYFRAME_INTERVAL;
+}
+
+
+
+int rewind_step(mos6507_t *cpu, mem_t *mem)
+{
+  uint8_t current[STATE_SIZE_MAX];
+  uint8_t state[STATE_SIZE_MAX];
+  rewind_record_t *record;
+  rewind_record_t *keyframe;
+  size_t size;
+  int n;
+
+  size = state_save(current, cpu, mem);
+  rewind_keyframe_age = 0; /* Start a new group when capturing again. */
+
+  while (rewind_count > 0) {
+    /* Find the keyframe that the newest record depends on. */
+    n = rewind_count - 1;
+    while (n > 0 && ! rewind_record[rewind_index(n)].keyframe) {
+      n--;
+    }
+    keyframe = &rewind_record[rewind_index(n)];
+    record = &rewind_record[rewind_index(rewind_count - 1)];
+
+    memcpy(state, &rewind_buffer[keyframe->offset], keyframe->size);
+    if (record != keyframe) {
+      rewind_rle_decode_xor(state, keyframe->size,
+        &rewind_buffer[record->offset], record->size);
+    }
+
+    rewind_count--;
+    rewind_write = record->offset;
+
+    /* Skip the snapshot of where the machine already is. */
+    if (keyframe->size != size || memcmp(state, current, size) != 0) {
+      return state_load(state, keyframe->size, cpu, mem);
+    }
+  }
+
+  return -1;
+}
+
+
+
+void rewind_dump(FILE *fh)
+{
+  int i;
+  size_t bytes;
+  int keyframes;
+
+  bytes = 0;
+  keyframes = 0;
+  for (i = 0; i < rewind_count; i++) {
+    bytes += rewind_record[rewind_index(i)].size;
+    if (rewind_record[rewind_index(i)].keyframe) {
+      keyframes++;
+    }
+  }
+
+  fprintf(fh, "Rewind Frames   : %d/%d\n", rewind_count, REWIND_FRAMES);
+  fprintf(fh, "Rewind Keyframes: %d\n", keyframes);
+  fprintf(fh, "Rewind Bytes    : %zu/%d\n", bytes, REWIND_BUFFER_SIZE);
+}
+
+
+
@@ -0,0 +1,13 @@
+#ifndef _REWIND_H
+#define _REWIND_H
+
+#include <stdio.h>
+#include "mos6507.h"
+#include "mem.h"
+
+void rewind_init(void);
+void rewind_capture(mos6507_t *cpu, mem_t *mem);
+int rewind_step(mos6507_t *cpu, mem_t *mem);
+void rewind_dump(FILE *fh);
+
+#endif /* _REWIND_H */
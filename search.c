@@ -0,0 +1,732 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "search.h"
+#include "state.h"
+#include "pia.h"
+#include "tia.h"
+#include "tas.h"
+#include "input.h"
+#include "ttable.h"
+
+
+
+/* Player 0 joystick: 9 directions, each with and without fire. */
+#define SEARCH_DIRECTIONS 9
+#define SEARCH_INPUTS (SEARCH_DIRECTIONS * 2)
+
+#define SEARCH_WIDTH_MAX 1024
+#define SEARCH_JOBS_MAX 64
+#define SEARCH_DEPTH_MAX 32 /* Decisions in an exhaustive fork search. */
+#define SEARCH_FORK_FRAMES 8
+
+
+
+typedef struct search_node_s {
+  uint8_t state[STATE_SIZE_MAX];
+  uint32_t size;
+  uint64_t hash;
+  int score;
+  int parent;
+  int input;
+} search_node_t;
+
+typedef struct search_job_s {
+  int input;
+  uint32_t size;
+} search_job_t;
+
+typedef struct search_result_s {
+  uint64_t hash;
+  int score;
+  uint32_t size;
+} search_result_t;
+
+typedef struct search_path_s {
+  int score;
+  uint32_t leaves;
+  uint32_t pruned; /* Branches cut for reaching a known state. */
+  uint8_t input[SEARCH_DEPTH_MAX];
+} search_path_t;
+
+typedef struct search_worker_s {
+  pid_t pid;
+  int job_fd;
+  int result_fd;
+  int node; /* Candidate being worked on, or -1 if idle. */
+} search_worker_t;
+
+
+
+static const uint8_t search_direction[SEARCH_DIRECTIONS] = {
+  0x00, /* None */
+  0x10, /* Up */
+  0x20, /* Down */
+  0x40, /* Left */
+  0x80, /* Right */
+  0x50, /* Up + Left */
+  0x90, /* Up + Right */
+  0x60, /* Down + Left */
+  0xA0, /* Down + Right */
+};
+
+static int search_address = -1;
+static bool search_minimize = false;
+static bool search_fork = false;
+static int search_frames = 600;
+static int search_width = 32;
+static int search_hold = 4;
+static int search_jobs = 0;
+
+static search_worker_t search_worker[SEARCH_JOBS_MAX];
+static search_node_t *search_candidate = NULL;
+static mos6507_t *search_fork_cpu = NULL;
+static mem_t *search_fork_mem = NULL;
+
+
+
+static int search_read(int fd, void *data, size_t size)
+{
+  ssize_t n;
+
+  while (size > 0) {
+    n = read(fd, data, size);
+    if (n <= 0) {
+      return -1;
+    }
+    data = (uint8_t *)data + n;
+    size -= n;
+  }
+  return 0;
+}
+
+
+
+static int search_write(int fd, const void *data, size_t size)
+{
+  ssize_t n;
+
+  while (size > 0) {
+    n = write(fd, data, size);
+    if (n <= 0) {
+      return -1;
+    }
+    data = (const uint8_t *)data + n;
+    size -= n;
+  }
+  return 0;
+}
+
+
+
+static void search_input_set(int input)
+{
+  tas_set(0xB, 0xFF & ~search_direction[input % SEARCH_DIRECTIONS],
+    input < SEARCH_DIRECTIONS, true);
+  input_latch();
+}
+
+
+
+static int search_score(mem_t *mem)
+{
+  return ((pia_t *)mem->pia)->ram[search_address & 0x7F];
+}
+
+
+
+static void search_worker_loop(int job_fd, int result_fd,
+  mos6507_t *cpu, mem_t *mem, void (*frame)(void))
+{
+  search_job_t job;
+  search_result_t result;
+  uint8_t state[STATE_SIZE_MAX];
+  int i;
+
+  ((tia_t *)mem->tia)->render = false;
+  ((tia_t *)mem->tia)->audio = false;
+
+  while (search_read(job_fd, &job, sizeof(job)) == 0) {
+    if (job.size > STATE_SIZE_MAX ||
+        search_read(job_fd, state, job.size) != 0) {
+      break;
+    }
+    state_load(state, job.size, cpu, mem);
+
+    search_input_set(job.input);
+    for (i = 0; i < search_hold; i++) {
+      frame();
+    }
+
+    result.score = search_score(mem);
+    result.hash = state_hash(cpu, mem);
+    result.size = state_save(state, cpu, mem);
+    if (search_write(result_fd, &result, sizeof(result)) != 0 ||
+        search_write(result_fd, state, result.size) != 0) {
+      break;
+    }
+  }
+
+  /* Skip atexit() handlers, those belong to the parent. */
+  _exit(EXIT_SUCCESS);
+}
+
+
+
+static int search_workers_start(mos6507_t *cpu, mem_t *mem,
+  void (*frame)(void))
+{
+  int job_pipe[2], result_pipe[2];
+  int i, j;
+
+  /* A worker that dies shows up as a failed write, not a signal. */
+  signal(SIGPIPE, SIG_IGN);
+
+  for (i = 0; i < search_jobs; i++) {
+    if (pipe(job_pipe) != 0) {
+      return -1;
+    }
+    if (pipe(result_pipe) != 0) {
+      close(job_pipe[0]);
+      close(job_pipe[1]);
+      return -1;
+    }
+
+    fflush(NULL);
+    search_worker[i].pid = fork();
+    if (search_worker[i].pid == -1) {
+      return -1;
+    }
+
+    if (search_worker[i].pid == 0) {
+      for (j = 0; j < i; j++) { /* Drop pipes to older siblings. */
+        close(search_worker[j].job_fd);
+        close(search_worker[j].result_fd);
+      }
+      close(job_pipe[1]);
+      close(result_pipe[0]);
+      search_worker_loop(job_pipe[0], result_pipe[1], cpu, mem, frame);
+    }
+
+    close(job_pipe[0]);
+    close(result_pipe[1]);
+    search_worker[i].job_fd = job_pipe[1];
+    search_worker[i].result_fd = result_pipe[0];
+    search_worker[i].node = -1;
+  }
+
+  return 0;
+}
+
+
+
+static void search_workers_stop(void)
+{
+  int i;
+
+  for (i = 0; i < search_jobs; i++) {
+    close(search_worker[i].job_fd);
+    close(search_worker[i].result_fd);
+  }
+  for (i = 0; i < search_jobs; i++) {
+    waitpid(search_worker[i].pid, NULL, 0);
+  }
+}
+
+
+
+static int search_dispatch(search_worker_t *worker, int node,
+  const search_node_t *beam)
+{
+  search_job_t job;
+  const search_node_t *parent;
+
+  parent = &beam[search_candidate[node].parent];
+  job.input = search_candidate[node].input;
+  job.size = parent->size;
+  worker->node = node;
+
+  if (search_write(worker->job_fd, &job, sizeof(job)) != 0 ||
+      search_write(worker->job_fd, parent->state, parent->size) != 0) {
+    return -1;
+  }
+  return 0;
+}
+
+
+
+static int search_expand(const search_node_t *beam, int beam_size)
+{
+  struct pollfd fds[SEARCH_JOBS_MAX];
+  search_result_t result;
+  search_node_t *node;
+  int count, next, done, i;
+
+  count = beam_size * SEARCH_INPUTS;
+  for (i = 0; i < count; i++) {
+    search_candidate[i].parent = i / SEARCH_INPUTS;
+    search_candidate[i].input = i % SEARCH_INPUTS;
+  }
+
+  /* Keep every worker busy with one candidate at a time. */
+  next = 0;
+  for (i = 0; i < search_jobs && next < count; i++) {
+    if (search_dispatch(&search_worker[i], next++, beam) != 0) {
+      return -1;
+    }
+  }
+
+  done = 0;
+  while (done < count) {
+    for (i = 0; i < search_jobs; i++) {
+      fds[i].fd = search_worker[i].result_fd;
+      fds[i].events = POLLIN;
+    }
+    if (poll(fds, search_jobs, -1) < 0) {
+      return -1;
+    }
+
+    for (i = 0; i < search_jobs; i++) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      if (search_worker[i].node < 0) {
+        /* Idle workers send nothing, so this one hung up or failed. */
+        waitpid(search_worker[i].pid, NULL, 0);
+        return -1;
+      }
+
+      node = &search_candidate[search_worker[i].node];
+      if (search_read(fds[i].fd, &result, sizeof(result)) != 0 ||
+          result.size > STATE_SIZE_MAX ||
+          search_read(fds[i].fd, node->state, result.size) != 0) {
+        return -1;
+      }
+      node->score = result.score;
+      node->hash = result.hash;
+      node->size = result.size;
+      search_worker[i].node = -1;
+      done++;
+
+      if (next < count) {
+        if (search_dispatch(&search_worker[i], next++, beam) != 0) {
+          return -1;
+        }
+      }
+    }
+  }
+
+  return count;
+}
+
+
+
+static bool search_better(int score, int other)
+{
+  if (search_minimize) {
+    return score < other;
+  } else {
+    return score > other;
+  }
+}
+
+
+
+static int search_compare(const void *a, const void *b)
+{
+  const search_node_t *na = &search_candidate[*(const int *)a];
+  const search_node_t *nb = &search_candidate[*(const int *)b];
+
+  if (search_better(na->score, nb->score)) {
+    return -1;
+  } else if (search_better(nb->score, na->score)) {
+    return 1;
+  }
+
+  /* Keep the search deterministic on ties. */
+  return *(const int *)a - *(const int *)b;
+}
+
+
+
+static void search_record(const int input[], int steps)
+{
+  int step, i;
+
+  for (step = 0; step < steps; step++) {
+    search_input_set(input[step]);
+    for (i = 0; i < search_hold; i++) {
+      tas_record(tas_get_system_switches(), tas_get_joystick_movement(),
+        tas_get_joystick_button_p0(), tas_get_joystick_button_p1());
+    }
+  }
+}
+
+
+
+static pid_t search_fork_branch(int input, int depth, int steps,
+  search_path_t *path, void (*frame)(void), int *result_fd);
+
+
+
+static void search_fork_collect(search_path_t *best, int fd, pid_t pid)
+{
+  search_path_t path;
+
+  /* A branch that died without an answer is simply left out. */
+  if (search_read(fd, &path, sizeof(path)) == 0) {
+    best->pruned += path.pruned;
+    if (path.leaves == 0) {
+      close(fd);
+      waitpid(pid, NULL, 0);
+      return;
+    }
+    if (best->leaves == 0 || search_better(path.score, best->score)) {
+      best->score = path.score;
+      memcpy(best->input, path.input, sizeof(path.input));
+    }
+    best->leaves += path.leaves;
+  }
+  close(fd);
+  waitpid(pid, NULL, 0);
+}
+
+
+
+static void search_fork_explore(int depth, int steps, search_path_t *path,
+  void (*frame)(void), int result_fd)
+{
+  search_path_t best;
+  pid_t pid;
+  int input, fd;
+
+  if (depth == steps) {
+    path->score = search_score(search_fork_mem);
+    path->leaves = 1;
+    path->pruned = 0;
+  } else {
+    /* Below the top level, one branch at a time keeps the process count
+       bounded by the depth. */
+    memset(&best, 0, sizeof(best));
+    for (input = 0; input < SEARCH_INPUTS; input++) {
+      pid = search_fork_branch(input, depth, steps, path, frame, &fd);
+      if (pid == -1) {
+        break;
+      }
+      search_fork_collect(&best, fd, pid);
+    }
+    *path = best;
+  }
+
+  search_write(result_fd, path, sizeof(search_path_t));
+  _exit(EXIT_SUCCESS);
+}
+
+
+
+static pid_t search_fork_branch(int input, int depth, int steps,
+  search_path_t *path, void (*frame)(void), int *result_fd)
+{
+  int result_pipe[2];
+  pid_t pid;
+  int i;
+
+  if (pipe(result_pipe) != 0) {
+    return -1;
+  }
+
+  pid = fork();
+  if (pid == -1) {
+    close(result_pipe[0]);
+    close(result_pipe[1]);
+    return -1;
+  }
+
+  if (pid == 0) {
+    /* The child owns a copy-on-write clone of the whole machine. */
+    close(result_pipe[0]);
+    path->input[depth] = input;
+    search_input_set(input);
+    for (i = 0; i < search_hold; i++) {
+      frame();
+    }
+
+    /* Same state at the same depth means the same subtree below. */
+    if (! ttable_insert(state_hash(search_fork_cpu, search_fork_mem) ^
+      ((uint64_t)depth << 58))) {
+      memset(path, 0, sizeof(search_path_t));
+      path->pruned = 1;
+      search_write(result_pipe[1], path, sizeof(search_path_t));
+      _exit(EXIT_SUCCESS);
+    }
+    search_fork_explore(depth + 1, steps, path, frame, result_pipe[1]);
+  }
+
+  close(result_pipe[1]);
+  *result_fd = result_pipe[0];
+  return pid;
+}
+
+
+
+static int search_fork_run(mos6507_t *cpu, mem_t *mem, void (*frame)(void),
+  int steps)
+{
+  search_path_t path, best;
+  pid_t pid[SEARCH_INPUTS];
+  int fd[SEARCH_INPUTS];
+  int input[SEARCH_DEPTH_MAX];
+  int started, done, step, i;
+  struct timespec start, end;
+  double seconds;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  search_fork_cpu = cpu;
+  search_fork_mem = mem;
+  ((tia_t *)mem->tia)->render = false;
+  ((tia_t *)mem->tia)->audio = false;
+  memset(&path, 0, sizeof(path));
+  memset(&best, 0, sizeof(best));
+  fflush(NULL);
+
+  /* Run up to JOBS of the first decisions in parallel. */
+  started = 0;
+  for (done = 0; done < SEARCH_INPUTS; done++) {
+    while (started < SEARCH_INPUTS && started - done < search_jobs) {
+      pid[started] = search_fork_branch(started, 0, steps, &path, frame,
+        &fd[started]);
+      if (pid[started] == -1) {
+        return -1;
+      }
+      started++;
+    }
+    search_fork_collect(&best, fd[done], pid[done]);
+    fprintf(stderr, "Search branch %d/%d, best score: %d\n",
+      done + 1, SEARCH_INPUTS, best.score);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  seconds = (end.tv_sec - start.tv_sec) +
+            (end.tv_nsec - start.tv_nsec) / 1e9;
+  if (best.leaves == 0) {
+    return -1;
+  }
+
+  /* Replay the winner so the machine is left in its final state. */
+  ((tia_t *)mem->tia)->render = true;
+  ((tia_t *)mem->tia)->audio = true;
+  for (step = 0; step < steps; step++) {
+    input[step] = best.input[step];
+    search_input_set(input[step]);
+    for (i = 0; i < search_hold; i++) {
+      frame();
+    }
+  }
+  search_record(input, steps);
+
+  fprintf(stdout, "Best score: %d (0x%02x) after %d frames\n",
+    best.score, best.score, steps * search_hold);
+  fprintf(stdout, "Explored %u branches in %.2f seconds (%.0f/s)\n",
+    best.leaves, seconds, best.leaves / (seconds > 0 ? seconds : 1));
+  fprintf(stdout, "Skipped %u branches reaching known states\n",
+    best.pruned);
+  return 0;
+}
+
+
+
+int search_parse(const char *spec, bool fork)
+{
+  char *end;
+  long value[5];
+  int n;
+
+  /* Format: [-]ADDR[,FRAMES[,WIDTH[,HOLD[,JOBS]]]], no WIDTH for fork. */
+  search_minimize = (*spec == '-');
+  if (search_minimize) {
+    spec++;
+  }
+
+  for (n = 0; n < 5; n++) {
+    value[n] = strtol(spec, &end, 0);
+    if (end == spec) {
+      return -1;
+    }
+    spec = end;
+    if (*spec != ',') {
+      n++;
+      break;
+    }
+    spec++;
+  }
+  if (*spec != '\0') {
+    return -1;
+  }
+
+  search_fork = fork;
+  search_address = value[0];
+  if (fork) {
+    search_frames = SEARCH_FORK_FRAMES;
+    if (n > 1) search_frames = value[1];
+    if (n > 2) search_hold   = value[2];
+    if (n > 3) search_jobs   = value[3];
+    if (n > 4) return -1;
+  } else {
+    if (n > 1) search_frames = value[1];
+    if (n > 2) search_width  = value[2];
+    if (n > 3) search_hold   = value[3];
+    if (n > 4) search_jobs   = value[4];
+  }
+
+  if (search_address < 0x80 || search_address > 0xFF ||
+      search_frames < 1 || search_hold < 1 ||
+      search_width < 1 || search_width > SEARCH_WIDTH_MAX ||
+      search_jobs < 0 || search_jobs > SEARCH_JOBS_MAX) {
+    return -1;
+  }
+  if (fork && (search_frames + search_hold - 1) / search_hold >
+    SEARCH_DEPTH_MAX) {
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+bool search_enabled(void)
+{
+  return search_address != -1;
+}
+
+
+
+static int search_beam(mos6507_t *cpu, mem_t *mem, void (*frame)(void),
+  search_node_t *beam, int *order, int *history, int *path, int steps)
+{
+  int beam_size, count, unique, step, i, index;
+
+  beam[0].size = state_save(beam[0].state, cpu, mem);
+  beam[0].score = search_score(mem);
+  beam_size = 1;
+  ttable_insert(state_hash(cpu, mem));
+
+  if (search_workers_start(cpu, mem, frame) != 0) {
+    return -1;
+  }
+
+  for (step = 0; step < steps; step++) {
+    count = search_expand(beam, beam_size);
+    if (count < 0) {
+      search_workers_stop();
+      return -1;
+    }
+
+    /* Drop candidates that arrive at a state already in the search, going
+       in candidate order so the outcome does not depend on the workers. */
+    unique = 0;
+    for (i = 0; i < count; i++) {
+      if (ttable_insert(search_candidate[i].hash)) {
+        order[unique++] = i;
+      }
+    }
+    if (unique == 0) {
+      steps = step; /* Every branch is a repeat, nothing new to find. */
+      break;
+    }
+    count = unique;
+    qsort(order, count, sizeof(int), search_compare);
+
+    /* Prune to the best candidates, remembering how they were reached. */
+    beam_size = (count < search_width) ? count : search_width;
+    for (i = 0; i < beam_size; i++) {
+      beam[i] = search_candidate[order[i]];
+      history[(step * search_width + i) * 2]     = beam[i].parent;
+      history[(step * search_width + i) * 2 + 1] = beam[i].input;
+    }
+
+    fprintf(stderr, "Search step %d/%d, best score: %d\n",
+      step + 1, steps, beam[0].score);
+  }
+
+  search_workers_stop();
+
+  /* Walk back from the best node to get the inputs leading to it. */
+  index = 0;
+  for (step = steps - 1; step >= 0; step--) {
+    path[step] = history[(step * search_width + index) * 2 + 1];
+    index = history[(step * search_width + index) * 2];
+  }
+  search_record(path, steps);
+
+  state_load(beam[0].state, beam[0].size, cpu, mem);
+  fprintf(stdout, "Best score: %d (0x%02x) after %d frames\n",
+    beam[0].score, beam[0].score, steps * search_hold);
+  return 0;
+}
+
+
+
+int search_run(mos6507_t *cpu, mem_t *mem, void (*frame)(void))
+{
+  search_node_t *beam;
+  int *order, *history, *path;
+  int steps, result;
+
+  if (search_jobs == 0) {
+    search_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (search_jobs < 1) {
+      search_jobs = 1;
+    } else if (search_jobs > SEARCH_JOBS_MAX) {
+      search_jobs = SEARCH_JOBS_MAX;
+    }
+  }
+  steps = (search_frames + search_hold - 1) / search_hold;
+
+  /* Without the table the search still works, only without pruning. */
+  if (ttable_init(TTABLE_BITS_DEFAULT) != 0) {
+    fprintf(stderr, "Failed to allocate transposition table!\n");
+  }
+
+  if (search_fork) {
+    result = search_fork_run(cpu, mem, frame, steps);
+    ttable_exit();
+    return result;
+  }
+
+  beam = malloc(sizeof(search_node_t) * search_width);
+  search_candidate = malloc(sizeof(search_node_t) *
+    search_width * SEARCH_INPUTS);
+  order = malloc(sizeof(int) * search_width * SEARCH_INPUTS);
+  history = malloc(sizeof(int) * 2 * search_width * steps);
+  path = malloc(sizeof(int) * steps);
+
+  if (beam == NULL || search_candidate == NULL ||
+      order == NULL || history == NULL || path == NULL) {
+    result = -1;
+  } else {
+    result = search_beam(cpu, mem, frame, beam, order, history, path,
+      steps);
+  }
+
+  free(beam);
+  free(search_candidate);
+  free(order);
+  free(history);
+  free(path);
+  search_candidate = NULL;
+  ttable_exit();
+  return result;
+}
+
+
+
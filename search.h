@@ -0,0 +1,12 @@
+#ifndef _SEARCH_H
+#define _SEARCH_H
+
+#include <stdbool.h>
+#include "mos6507.h"
+#include "mem.h"
+
+int search_parse(const char *spec, bool fork);
+bool search_enabled(void);
+int search_run(mos6507_t *cpu, mem_t *mem, void (*frame)(void));
+
+#endif /* _SEARCH_H */
@@ -0,0 +1,453 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "state.h"
+#include "mos6507.h"
+#include "mem.h"
+#include "pia.h"
+#include "tia.h"
+#include "cart.h"
+
+/* Only the mutable machine state is stored, in a fixed field order with
+   multi-byte values in little-endian, so files are portable between hosts.
+   Any change to the layout must bump STATE_VERSION. */
+
+#define STATE_MAGIC "A26S"
+#define STATE_MAGIC_SIZE 4
+#define STATE_PIA_RAM_USED 0x80
+#define STATE_FILENAME_MAX 1024
+#define STATE_HASH_MULTIPLIER 0x9E3779B97F4A7C15ULL
+
+typedef struct state_stream_s {
+  uint8_t *data;
+  const uint8_t *in;
+  size_t pos;
+  size_t size;
+} state_stream_t;
+
+
+
+static inline void state_put8(state_stream_t *s, uint8_t value)
+{
+  s->data[s->pos++] = value;
+}
+
+static inline void state_put16(state_stream_t *s, uint16_t value)
+{
+  s->data[s->pos++] = value & 0xFF;
+  s->data[s->pos++] = value >> 8;
+}
+
+static inline uint8_t state_get8(state_stream_t *s)
+{
+  if (s->pos + 1 > s->size) {
+    s->pos = s->size + 1; /* Flag overrun, checked at the end. */
+    return 0;
+  }
+  return s->in[s->pos++];
+}
+
+static inline uint16_t state_get16(state_stream_t *s)
+{
+  uint16_t value;
+  value  = state_get8(s);
+  value += state_get8(s) << 8;
+  return value;
+}
+
+
+
+static uint8_t state_cpu_flags(mos6507_t *cpu)
+{
+  return (cpu->sr.n << 7) + (cpu->sr.v << 6) + (cpu->sr.b << 4) +
+         (cpu->sr.d << 3) + (cpu->sr.i << 2) + (cpu->sr.z << 1) +
+          cpu->sr.c;
+}
+
+static void state_save_cpu(state_stream_t *s, mos6507_t *cpu)
+{
+  state_put16(s, cpu->pc);
+  state_put8(s, cpu->a);
+  state_put8(s, cpu->x);
+  state_put8(s, cpu->y);
+  state_put8(s, cpu->sp);
+  state_put8(s, state_cpu_flags(cpu));
+  state_put8(s, cpu->cycles);
+}
+
+static void state_load_cpu(state_stream_t *s, mos6507_t *cpu)
+{
+  uint8_t flags;
+
+  cpu->pc = state_get16(s);
+  cpu->a  = state_get8(s);
+  cpu->x  = state_get8(s);
+  cpu->y  = state_get8(s);
+  cpu->sp = state_get8(s);
+  flags   = state_get8(s);
+  cpu->sr.n = (flags >> 7) & 1;
+  cpu->sr.v = (flags >> 6) & 1;
+  cpu->sr.b = (flags >> 4) & 1;
+  cpu->sr.d = (flags >> 3) & 1;
+  cpu->sr.i = (flags >> 2) & 1;
+  cpu->sr.z = (flags >> 1) & 1;
+  cpu->sr.c =  flags       & 1;
+  cpu->cycles = state_get8(s);
+}
+
+
+
+static void state_save_pia(state_stream_t *s, pia_t *pia)
+{
+  pia_update(pia);
+  memcpy(&s->data[s->pos], pia->ram, STATE_PIA_RAM_USED);
+  s->pos += STATE_PIA_RAM_USED;
+  state_put8(s, pia->port_a);
+  state_put8(s, pia->port_b);
+  state_put8(s, pia->port_a_ddr);
+  state_put8(s, pia->port_b_ddr);
+  state_put8(s, pia->timer);
+  state_put16(s, pia->interval);
+  state_put16(s, pia->cycle);
+  state_put8(s, pia->underflow);
+}
+
+static void state_load_pia(state_stream_t *s, pia_t *pia)
+{
+  int i;
+
+  for (i = 0; i < STATE_PIA_RAM_USED; i++) {
+    pia->ram[i] = state_get8(s);
+  }
+  pia->port_a     = state_get8(s);
+  pia->port_b     = state_get8(s);
+  pia->port_a_ddr = state_get8(s);
+  pia->port_b_ddr = state_get8(s);
+  pia->timer      = state_get8(s);
+  pia->interval   = state_get16(s);
+  pia->cycle      = state_get16(s);
+  pia->underflow  = state_get8(s);
+  pia->timer_clock = pia->clock; /* Loaded fields are valid from now. */
+}
+
+
+
+static void state_save_tia(state_stream_t *s, tia_t *tia)
+{
+  int i;
+
+  state_put8(s, tia->dot);
+  state_put16(s, tia->scanline);
+  state_put8(s, tia->rdy);
+  state_put8(s, tia->vsync);
+  state_put8(s, tia->vsync_done);
+  state_put8(s, tia->vblank);
+  state_put8(s, tia->hmove_executed);
+  state_put16(s, tia->wsync_count);
+
+  for (i = 0; i < TIA_INPUTS; i++) {
+    state_put8(s, tia->input[i].state);
+    state_put8(s, tia->input[i].control);
+  }
+
+  for (i = 0; i < TIA_OBJECTS; i++) {
+    state_put8(s, tia->object[i].enabled);
+    state_put8(s, tia->object[i].pos);
+    state_put8(s, tia->object[i].shape);
+    state_put8(s, tia->object[i].motion);
+    state_put8(s, tia->object[i].reflect);
+    state_put8(s, tia->object[i].reset);
+    state_put8(s, tia->object[i].color);
+    state_put8(s, tia->object[i].size);
+    state_put8(s, tia->object[i].vdelay);
+    state_put8(s, tia->object[i].vdata);
+  }
+
+  state_put8(s, tia->playfield[0]);
+  state_put8(s, tia->playfield[1]);
+  state_put8(s, tia->playfield[2]);
+  state_put8(s, tia->playfield_reflect);
+  state_put8(s, tia->playfield_score_mode);
+  state_put8(s, tia->playfield_priority);
+  state_put8(s, tia->playfield_color);
+  state_put8(s, tia->background_color);
+
+  for (i = 0; i < TIA_COLLISIONS; i++) {
+    state_put8(s, tia->collision[i]);
+  }
+
+  /* The scanline being drawn, in case the state is taken mid-scanline. */
+  for (i = 0; i < TIA_SCANLINE_WIDTH; i++) {
+    state_put8(s, tia->scanline_colors[i]);
+  }
+  for (i = 0; i < TIA_SCANLINE_WIDTH; i++) {
+    state_put8(s, tia->scanline_object[i]);
+  }
+}
+
+static void state_load_tia(state_stream_t *s, tia_t *tia)
+{
+  int i;
+
+  tia->dot            = state_get8(s);
+  tia->scanline       = state_get16(s);
+  tia->rdy            = state_get8(s);
+  tia->vsync          = state_get8(s);
+  tia->vsync_done     = state_get8(s);
+  tia->vblank         = state_get8(s);
+  tia->hmove_executed = state_get8(s);
+  tia->wsync_count    = state_get16(s);
+
+  for (i = 0; i < TIA_INPUTS; i++) {
+    tia->input[i].state   = state_get8(s);
+    tia->input[i].control = state_get8(s);
+  }
+
+  for (i = 0; i < TIA_OBJECTS; i++) {
+    tia->object[i].enabled = state_get8(s);
+    tia->object[i].pos     = state_get8(s);
+    tia->object[i].shape   = state_get8(s);
+    tia->object[i].motion  = state_get8(s);
+    tia->object[i].reflect = state_get8(s);
+    tia->object[i].reset   = state_get8(s);
+    tia->object[i].color   = state_get8(s);
+    tia->object[i].size    = state_get8(s);
+    tia->object[i].vdelay  = state_get8(s);
+    tia->object[i].vdata   = state_get8(s);
+  }
+
+  tia->playfield[0]         = state_get8(s);
+  tia->playfield[1]         = state_get8(s);
+  tia->playfield[2]         = state_get8(s);
+  tia->playfield_reflect    = state_get8(s);
+  tia->playfield_score_mode = state_get8(s);
+  tia->playfield_priority   = state_get8(s);
+  tia->playfield_color      = state_get8(s);
+  tia->background_color     = state_get8(s);
+
+  for (i = 0; i < TIA_COLLISIONS; i++) {
+    tia->collision[i] = state_get8(s);
+  }
+
+  for (i = 0; i < TIA_SCANLINE_WIDTH; i++) {
+    tia->scanline_colors[i] = state_get8(s);
+  }
+  for (i = 0; i < TIA_SCANLINE_WIDTH; i++) {
+    tia->scanline_object[i] = state_get8(s);
+  }
+}
+
+
+
+static void state_save_cart(state_stream_t *s, cart_t *cart)
+{
+  int i;
+
+  state_put8(s, cart->type);
+  for (i = 0; i < CART_SLOTS; i++) {
+    state_put8(s, cart->bank.select[i]);
+  }
+  state_put8(s, cart->bank.latch);
+  memcpy(&s->data[s->pos], cart->bank.ram, cart->mapper->ram_size);
+  s->pos += cart->mapper->ram_size;
+}
+
+static int state_load_cart(state_stream_t *s, cart_t *cart, cart_bank_t *bank)
+{
+  int i;
+
+  if (state_get8(s) != cart->type) {
+    return -1; /* State is from another type of cartridge. */
+  }
+  for (i = 0; i < CART_SLOTS; i++) {
+    bank->select[i] = state_get8(s);
+  }
+  bank->latch = state_get8(s);
+  if (s->pos + cart->mapper->ram_size > s->size) {
+    return -1;
+  }
+  memcpy(bank->ram, &s->in[s->pos], cart->mapper->ram_size);
+  s->pos += cart->mapper->ram_size;
+  return 0;
+}
+
+
+
+size_t state_save(uint8_t buffer[], mos6507_t *cpu, mem_t *mem)
+{
+  state_stream_t s;
+
+  s.data = buffer;
+  s.pos = 0;
+
+  memcpy(s.data, STATE_MAGIC, STATE_MAGIC_SIZE);
+  s.pos += STATE_MAGIC_SIZE;
+  state_put8(&s, STATE_VERSION);
+
+  state_save_cpu(&s, cpu);
+  state_save_pia(&s, (pia_t *)mem->pia);
+  state_save_tia(&s, (tia_t *)mem->tia);
+  state_save_cart(&s, (cart_t *)mem->cart);
+
+  return s.pos;
+}
+
+
+
+int state_load(const uint8_t buffer[], size_t size,
+  mos6507_t *cpu, mem_t *mem)
+{
+  state_stream_t s;
+  mos6507_t new_cpu;
+  pia_t new_pia;
+  tia_t new_tia;
+  cart_bank_t new_bank;
+  cart_t *cart;
+
+  if (size < STATE_MAGIC_SIZE + 1) {
+    return -1;
+  }
+  if (memcmp(buffer, STATE_MAGIC, STATE_MAGIC_SIZE) != 0) {
+    return -1;
+  }
+  if (buffer[STATE_MAGIC_SIZE] != STATE_VERSION) {
+    return -1;
+  }
+
+  s.in = buffer;
+  s.pos = STATE_MAGIC_SIZE + 1;
+  s.size = size;
+
+  /* Decode into copies first, so nothing is touched if the data is bad. */
+  memcpy(&new_cpu, cpu, sizeof(mos6507_t));
+  memcpy(&new_pia, mem->pia, sizeof(pia_t));
+  memcpy(&new_tia, mem->tia, sizeof(tia_t));
+  cart = (cart_t *)mem->cart;
+  memcpy(&new_bank, &cart->bank, sizeof(cart_bank_t));
+
+  state_load_cpu(&s, &new_cpu);
+  state_load_pia(&s, &new_pia);
+  state_load_tia(&s, &new_tia);
+  if (state_load_cart(&s, cart, &new_bank) != 0 || s.pos > s.size) {
+    return -1;
+  }
+
+  memcpy(cpu, &new_cpu, sizeof(mos6507_t));
+  memcpy(mem->pia, &new_pia, sizeof(pia_t));
+  memcpy(mem->tia, &new_tia, sizeof(tia_t));
+  memcpy(&cart->bank, &new_bank, sizeof(cart_bank_t));
+  cart_map(cart);
+  return 0;
+}
+
+
+
+static void state_filename(char *filename, const char *prefix, int slot)
+{
+  snprintf(filename, STATE_FILENAME_MAX, "%s.state%d", prefix, slot);
+}
+
+
+
+int state_save_slot(const char *prefix, int slot, mos6507_t *cpu, mem_t *mem)
+{
+  char filename[STATE_FILENAME_MAX];
+  uint8_t buffer[STATE_SIZE_MAX];
+  size_t size;
+  FILE *fh;
+
+  state_filename(filename, prefix, slot);
+  fh = fopen(filename, "wb");
+  if (fh == NULL) {
+    return -1;
+  }
+
+  size = state_save(buffer, cpu, mem);
+  if (fwrite(buffer, sizeof(uint8_t), size, fh) != size) {
+    fclose(fh);
+    return -1;
+  }
+
+  fclose(fh);
+  return 0;
+}
+
+
+
+int state_load_slot(const char *prefix, int slot, mos6507_t *cpu, mem_t *mem)
+{
+  char filename[STATE_FILENAME_MAX];
+  uint8_t buffer[STATE_SIZE_MAX];
+  size_t size;
+  FILE *fh;
+
+  state_filename(filename, prefix, slot);
+  fh = fopen(filename, "rb");
+  if (fh == NULL) {
+    return -1;
+  }
+
+  size = fread(buffer, sizeof(uint8_t), STATE_SIZE_MAX, fh);
+  fclose(fh);
+
+  return state_load(buffer, size, cpu, mem);
+}
+
+
+
+static inline uint64_t state_hash_mix(uint64_t hash, uint64_t value)
+{
+  hash = (hash ^ value) * STATE_HASH_MULTIPLIER;
+  return hash ^ (hash >> 29);
+}
+
+
+
+uint64_t state_hash(mos6507_t *cpu, mem_t *mem)
+{
+  pia_t *pia = (pia_t *)mem->pia;
+  tia_t *tia = (tia_t *)mem->tia;
+  cart_t *cart = (cart_t *)mem->cart;
+  uint64_t hash, word;
+  int i;
+
+  /* Identifies a position for search, mixing 64 bits at a time. It covers
+     what decides where a game goes next, not the complete state. Cartridge
+     RAM sizes are all multiples of 8 bytes. */
+  hash = 0;
+  for (i = 0; i < STATE_PIA_RAM_USED; i += sizeof(word)) {
+    memcpy(&word, &pia->ram[i], sizeof(word));
+    hash = state_hash_mix(hash, word);
+  }
+
+  word = cpu->pc | ((uint64_t)cpu->a << 16) | ((uint64_t)cpu->x << 24) |
+         ((uint64_t)cpu->y << 32) | ((uint64_t)cpu->sp << 40) |
+         ((uint64_t)state_cpu_flags(cpu) << 48);
+  hash = state_hash_mix(hash, word);
+
+  pia_update(pia);
+  word = pia->timer;
+  for (i = 0; i < TIA_OBJECTS; i++) {
+    word |= (uint64_t)tia->object[i].pos << (8 + i * 8);
+  }
+  hash = state_hash_mix(hash, word);
+
+  word = 0;
+  for (i = 0; i < CART_SLOTS; i++) {
+    word |= (uint64_t)cart->bank.select[i] << (i * 8);
+  }
+  hash = state_hash_mix(hash, word);
+
+  for (i = 0; i < cart->mapper->ram_size; i += sizeof(word)) {
+    memcpy(&word, &cart->bank.ram[i], sizeof(word));
+    hash = state_hash_mix(hash, word);
+  }
+
+  return hash;
+}
+
+
+
@@ -0,0 +1,20 @@
+#ifndef _STATE_H
+#define _STATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "mos6507.h"
+#include "mem.h"
+
+#define STATE_VERSION 2
+#define STATE_SIZE_MAX 4096
+#define STATE_SLOTS 10
+
+size_t state_save(uint8_t buffer[], mos6507_t *cpu, mem_t *mem);
+int state_load(const uint8_t buffer[], size_t size,
+  mos6507_t *cpu, mem_t *mem);
+int state_save_slot(const char *prefix, int slot, mos6507_t *cpu, mem_t *mem);
+int state_load_slot(const char *prefix, int slot, mos6507_t *cpu, mem_t *mem);
+uint64_t state_hash(mos6507_t *cpu, mem_t *mem);
+
+#endif /* _STATE_H */
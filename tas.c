@@ -1,94 +1,240 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <strings.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#include "tas.h"
 
 
-#define TAS_DATA_MAX 81920
 
+/* Binary format: Magic and version, then records of a run length followed
+   by player 0, player 1 and system switches bytes for each frame in the run.
+   Player bits (1 = pressed): 0 = Up, 1 = Down, 2 = Left, 3 = Right, 4 = Fire.
+   System switches are stored as seen on port B. */
+#define TAS_MAGIC "A26T"
+#define TAS_MAGIC_SIZE 4
+#define TAS_VERSION 1
+#define TAS_HEADER_SIZE (TAS_MAGIC_SIZE + 1)
+#define TAS_RECORD_SIZE 4
 
+#define TAS_CSV_LINE_SIZE 23 /* 12 fields with commas in between. */
 
-static uint8_t tas_system_switches[TAS_DATA_MAX];
-static uint8_t tas_joystick_movement[TAS_DATA_MAX];
-static bool tas_joystick_button_p0[TAS_DATA_MAX];
-static bool tas_joystick_button_p1[TAS_DATA_MAX];
-static unsigned int tas_data_index = 0;
-static unsigned int tas_data_end = 0;
+#define TAS_RECORD_BUFFER_SIZE 0x10000
+#define TAS_RECORD_RUN_MAX 0xFF
+
+
+
+static const char *tas_data = NULL;
+static size_t tas_size = 0;
+static size_t tas_pos = 0;
+static bool tas_binary = false;
+static int tas_run = 0; /* Frames left in current binary record. */
+
+static uint8_t tas_system_switches = 0xB;
+static uint8_t tas_joystick_movement = 0xFF;
+static bool tas_joystick_button_p0 = true;
+static bool tas_joystick_button_p1 = true;
 static bool tas_active = false;
 
+/* Recording is double buffered, the frame loop only appends to one buffer
+   while a writer thread stores the other one to disk. */
+static FILE *tas_record_fh = NULL;
+static bool tas_record_csv = false;
+static uint8_t tas_record_buffer[2][TAS_RECORD_BUFFER_SIZE];
+static size_t tas_record_fill[2];
+static int tas_record_current = 0;
+static bool tas_record_pending = false;
+static bool tas_record_quit = false;
+static pthread_t tas_record_thread;
+static pthread_mutex_t tas_record_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tas_record_cond = PTHREAD_COND_INITIALIZER;
+static uint8_t tas_record_last[3];
+static int tas_record_run = 0;
+
+
+
+static void tas_decode_player(uint8_t player, int shift, bool *button)
+{
+  if (player & TAS_PLAYER_UP)    tas_joystick_movement &= ~(0x10 >> shift);
+  if (player & TAS_PLAYER_DOWN)  tas_joystick_movement &= ~(0x20 >> shift);
+  if (player & TAS_PLAYER_LEFT)  tas_joystick_movement &= ~(0x40 >> shift);
+  if (player & TAS_PLAYER_RIGHT) tas_joystick_movement &= ~(0x80 >> shift);
+  *button = ! (player & TAS_PLAYER_FIRE);
+}
+
+
+
+static bool tas_next_binary(void)
+{
+  const uint8_t *record;
+
+  /* Skip empty runs. */
+  while (tas_run == 0) {
+    if (tas_pos + TAS_RECORD_SIZE > tas_size) {
+      return false;
+    }
+    tas_run = (uint8_t)tas_data[tas_pos];
+    tas_pos += TAS_RECORD_SIZE;
+  }
+
+  record = (const uint8_t *)&tas_data[tas_pos - TAS_RECORD_SIZE];
+  tas_joystick_movement = 0xFF;
+  tas_decode_player(record[1], 0, &tas_joystick_button_p0);
+  tas_decode_player(record[2], 4, &tas_joystick_button_p1);
+  tas_system_switches = record[3];
+  tas_run--;
+
+  return true;
+}
+
+
+
+static bool tas_next_csv(void)
+{
+  const char *line;
+  const char *end;
+  uint8_t p0, p1;
+  int i;
+
+  /* Format: p0u,p0d,p0l,p0r,p0b,p1u,p1d,p1l,p1r,p1b,s,r */
+  while (tas_pos < tas_size) {
+    line = &tas_data[tas_pos];
+    end = memchr(line, '\n', tas_size - tas_pos);
+    if (end == NULL) {
+      end = &tas_data[tas_size];
+    }
+    tas_pos = (end - tas_data) + 1;
+
+    if (end - line < TAS_CSV_LINE_SIZE) {
+      continue;
+    }
+    for (i = 1; i < TAS_CSV_LINE_SIZE; i += 2) {
+      if (line[i] != ',') {
+        break;
+      }
+    }
+    if (i < TAS_CSV_LINE_SIZE) {
+      continue; /* Not a valid line, ignore it. */
+    }
+
+    p0 = 0;
+    if (line[0]  == '1') p0 |= TAS_PLAYER_UP;
+    if (line[2]  == '1') p0 |= TAS_PLAYER_DOWN;
+    if (line[4]  == '1') p0 |= TAS_PLAYER_LEFT;
+    if (line[6]  == '1') p0 |= TAS_PLAYER_RIGHT;
+    if (line[8]  == '1') p0 |= TAS_PLAYER_FIRE;
+    p1 = 0;
+    if (line[10] == '1') p1 |= TAS_PLAYER_UP;
+    if (line[12] == '1') p1 |= TAS_PLAYER_DOWN;
+    if (line[14] == '1') p1 |= TAS_PLAYER_LEFT;
+    if (line[16] == '1') p1 |= TAS_PLAYER_RIGHT;
+    if (line[18] == '1') p1 |= TAS_PLAYER_FIRE;
+
+    tas_joystick_movement = 0xFF;
+    tas_decode_player(p0, 0, &tas_joystick_button_p0);
+    tas_decode_player(p1, 4, &tas_joystick_button_p1);
+
+    tas_system_switches = 0xB;
+    if (line[20] == '1') tas_system_switches &= ~0x2;
+    if (line[22] == '1') tas_system_switches &= ~0x1;
+
+    return true;
+  }
+
+  return false;
+}
+
+
+
+static void tas_next(void)
+{
+  bool decoded;
+
+  if (tas_binary) {
+    decoded = tas_next_binary();
+  } else {
+    decoded = tas_next_csv();
+  }
+
+  if (! decoded) {
+    /* End of input, release the file and hand back to the user. */
+    tas_active = false;
+    if (tas_data != NULL) {
+      munmap((void *)tas_data, tas_size);
+      tas_data = NULL;
+    }
+    tas_size = 0;
+    tas_pos = 0;
+    tas_run = 0;
+  }
+}
+
 
 
 int tas_init(const char *filename)
 {
-  int n, result;
-  FILE *fh;
-  char buffer[32];
-  uint8_t system_switches;
-  uint8_t joystick_movement;
-  bool joystick_button_p0;
-  bool joystick_button_p1;
-  char p0u, p0d, p0l, p0r, p0b, p1u, p1d, p1l, p1r, p1b, s, r;
-
-  fh = fopen(filename, "r");
-  if (fh == NULL) {
+  int fd;
+  struct stat st;
+
+  fd = open(filename, O_RDONLY);
+  if (fd == -1) {
     return -1;
   }
 
-  tas_data_index = 0;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  tas_size = st.st_size;
+  tas_pos = 0;
+  tas_run = 0;
   tas_active = true;
 
-  n = 0;
-  while (fgets(buffer, sizeof(buffer), fh) != NULL) {
-    /* Format: p0u,p0d,p0l,p0r,p0b,p1u,p1d,p1l,p1r,p1b,s,r */
-    result = sscanf(buffer, "%c,%c,%c,%c,%c,%c,%c,%c,%c,%c,%c,%c\n",
-      &p0u, &p0d, &p0l, &p0r, &p0b, &p1u, &p1d, &p1l, &p1r, &p1b, &s, &r);
-
-    if (result == 12) {
-      system_switches = 0xB;
-      joystick_movement = 0xFF;
-      joystick_button_p0 = true;
-      joystick_button_p1 = true;
-
-      if (s == '1') system_switches &= ~0x2;
-      if (r == '1') system_switches &= ~0x1;
-      tas_system_switches[n] = system_switches;
-
-      if (p0r == '1') joystick_movement &= ~0x80;
-      if (p0l == '1') joystick_movement &= ~0x40;
-      if (p0d == '1') joystick_movement &= ~0x20;
-      if (p0u == '1') joystick_movement &= ~0x10;
-      if (p1r == '1') joystick_movement &= ~0x08;
-      if (p1l == '1') joystick_movement &= ~0x04;
-      if (p1d == '1') joystick_movement &= ~0x02;
-      if (p1u == '1') joystick_movement &= ~0x01;
-      tas_joystick_movement[n] = joystick_movement;
-
-      if (p0b == '1') joystick_button_p0 = false;
-      tas_joystick_button_p0[n] = joystick_button_p0;
-      if (p1b == '1') joystick_button_p1 = false;
-      tas_joystick_button_p1[n] = joystick_button_p1;
-
-      n++;
-      if (n >= TAS_DATA_MAX) {
-        fprintf(stderr, "Overflow in TAS data.\n");
-        return -1;
-      }
+  if (tas_size == 0) {
+    close(fd);
+    tas_active = false;
+    return 0;
+  }
+
+  /* Frames are decoded from the mapping as they are needed. */
+  tas_data = mmap(NULL, tas_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (tas_data == MAP_FAILED) {
+    tas_data = NULL;
+    return -1;
+  }
+  madvise((void *)tas_data, tas_size, MADV_SEQUENTIAL);
+
+  tas_binary = false;
+  if (tas_size >= TAS_HEADER_SIZE &&
+      memcmp(tas_data, TAS_MAGIC, TAS_MAGIC_SIZE) == 0) {
+    if (tas_data[TAS_MAGIC_SIZE] != TAS_VERSION) {
+      munmap((void *)tas_data, tas_size);
+      tas_data = NULL;
+      return -1;
     }
+    tas_binary = true;
+    tas_pos = TAS_HEADER_SIZE;
   }
-  tas_data_end = n;
 
-  fclose(fh);
+  tas_next();
   return 0;
 }
 
 
 
-int tas_init(const char *filename);
 uint8_t tas_get_system_switches(void)
 {
   if (tas_active) {
-    return tas_system_switches[tas_data_index];
+    return tas_system_switches;
   } else {
     return 0xB;
   }
@@ -99,7 +245,7 @@ uint8_t tas_get_system_switches(void)
 uint8_t tas_get_joystick_movement(void)
 {
   if (tas_active) {
-    return tas_joystick_movement[tas_data_index];
+    return tas_joystick_movement;
   } else {
     return 0xFF;
   }
@@ -110,7 +256,7 @@ uint8_t tas_get_joystick_movement(void)
 bool tas_get_joystick_button_p0(void)
 {
   if (tas_active) {
-    return tas_joystick_button_p0[tas_data_index];
+    return tas_joystick_button_p0;
   } else {
     return true;
   }
@@ -121,7 +267,7 @@ bool tas_get_joystick_button_p0(void)
 bool tas_get_joystick_button_p1(void)
 {
   if (tas_active) {
-    return tas_joystick_button_p1[tas_data_index];
+    return tas_joystick_button_p1;
   } else {
     return true;
   }
@@ -135,13 +281,7 @@ void tas_update(void)
     return;
   }
 
-  tas_data_index++;
-
-  if (tas_data_index >= TAS_DATA_MAX ||
-      tas_data_index >= tas_data_end) {
-    tas_data_index = 0;
-    tas_active = false;
-  }
+  tas_next();
 }
 
 
@@ -153,3 +293,213 @@ bool tas_is_active(void)
 
 
 
+void tas_set(uint8_t system_switches, uint8_t joystick_movement,
+  bool joystick_button_p0, bool joystick_button_p1)
+{
+  /* Input is held until the next tas_update() decodes a frame. */
+  tas_system_switches = system_switches;
+  tas_joystick_movement = joystick_movement;
+  tas_joystick_button_p0 = joystick_button_p0;
+  tas_joystick_button_p1 = joystick_button_p1;
+  tas_active = true;
+}
+
+
+
+static uint8_t tas_encode_player(uint8_t movement, int shift, bool button)
+{
+  uint8_t player = 0;
+
+  if (! (movement & (0x10 >> shift))) player |= TAS_PLAYER_UP;
+  if (! (movement & (0x20 >> shift))) player |= TAS_PLAYER_DOWN;
+  if (! (movement & (0x40 >> shift))) player |= TAS_PLAYER_LEFT;
+  if (! (movement & (0x80 >> shift))) player |= TAS_PLAYER_RIGHT;
+  if (! button)                       player |= TAS_PLAYER_FIRE;
+  return player;
+}
+
+
+
+static void *tas_record_writer(void *arg)
+{
+  int index;
+
+  (void)arg;
+  pthread_mutex_lock(&tas_record_mutex);
+  while (1) {
+    while (! tas_record_pending && ! tas_record_quit) {
+      pthread_cond_wait(&tas_record_cond, &tas_record_mutex);
+    }
+    if (! tas_record_pending) {
+      break;
+    }
+    index = tas_record_current ^ 1;
+    pthread_mutex_unlock(&tas_record_mutex);
+
+    fwrite(tas_record_buffer[index], 1, tas_record_fill[index],
+      tas_record_fh);
+    fflush(tas_record_fh);
+
+    pthread_mutex_lock(&tas_record_mutex);
+    tas_record_pending = false;
+    pthread_cond_broadcast(&tas_record_cond);
+  }
+  pthread_mutex_unlock(&tas_record_mutex);
+
+  return NULL;
+}
+
+
+
+static void tas_record_swap(void)
+{
+  pthread_mutex_lock(&tas_record_mutex);
+  while (tas_record_pending) { /* Only waits if the disk falls behind. */
+    pthread_cond_wait(&tas_record_cond, &tas_record_mutex);
+  }
+  tas_record_current ^= 1;
+  tas_record_fill[tas_record_current] = 0;
+  tas_record_pending = true;
+  pthread_cond_broadcast(&tas_record_cond);
+  pthread_mutex_unlock(&tas_record_mutex);
+}
+
+
+
+static void tas_record_put(const void *data, size_t size)
+{
+  int index = tas_record_current;
+
+  if (tas_record_fill[index] + size > TAS_RECORD_BUFFER_SIZE) {
+    tas_record_swap();
+    index = tas_record_current;
+  }
+  memcpy(&tas_record_buffer[index][tas_record_fill[index]], data, size);
+  tas_record_fill[index] += size;
+}
+
+
+
+static void tas_record_flush_run(void)
+{
+  uint8_t record[TAS_RECORD_SIZE];
+
+  if (tas_record_run == 0) {
+    return;
+  }
+  record[0] = tas_record_run;
+  record[1] = tas_record_last[0];
+  record[2] = tas_record_last[1];
+  record[3] = tas_record_last[2];
+  tas_record_put(record, TAS_RECORD_SIZE);
+  tas_record_run = 0;
+}
+
+
+
+static void tas_record_exit(void)
+{
+  if (tas_record_fh == NULL) {
+    return;
+  }
+
+  tas_record_flush_run();
+  if (tas_record_fill[tas_record_current] > 0) {
+    tas_record_swap();
+  }
+
+  pthread_mutex_lock(&tas_record_mutex);
+  tas_record_quit = true;
+  pthread_cond_broadcast(&tas_record_cond);
+  pthread_mutex_unlock(&tas_record_mutex);
+  pthread_join(tas_record_thread, NULL);
+
+  fclose(tas_record_fh);
+  tas_record_fh = NULL;
+}
+
+
+
+int tas_record_init(const char *filename)
+{
+  const char *ext;
+  uint8_t header[TAS_HEADER_SIZE];
+
+  tas_record_fh = fopen(filename, "wb");
+  if (tas_record_fh == NULL) {
+    return -1;
+  }
+
+  /* Files ending in ".csv" use the CSV format, everything else binary. */
+  ext = strrchr(filename, '.');
+  tas_record_csv = (ext != NULL && strcasecmp(ext, ".csv") == 0);
+
+  tas_record_current = 0;
+  tas_record_fill[0] = 0;
+  tas_record_pending = false;
+  tas_record_quit = false;
+  tas_record_run = 0;
+
+  if (pthread_create(&tas_record_thread, NULL, tas_record_writer,
+    NULL) != 0) {
+    fclose(tas_record_fh);
+    tas_record_fh = NULL;
+    return -1;
+  }
+  atexit(tas_record_exit);
+
+  if (! tas_record_csv) {
+    memcpy(header, TAS_MAGIC, TAS_MAGIC_SIZE);
+    header[TAS_MAGIC_SIZE] = TAS_VERSION;
+    tas_record_put(header, TAS_HEADER_SIZE);
+  }
+
+  return 0;
+}
+
+
+
+void tas_record(uint8_t system_switches, uint8_t joystick_movement,
+  bool joystick_button_p0, bool joystick_button_p1)
+{
+  uint8_t frame[3];
+  char line[TAS_CSV_LINE_SIZE + 1];
+  int i;
+
+  if (tas_record_fh == NULL) {
+    return;
+  }
+
+  frame[0] = tas_encode_player(joystick_movement, 0, joystick_button_p0);
+  frame[1] = tas_encode_player(joystick_movement, 4, joystick_button_p1);
+  frame[2] = system_switches;
+
+  if (tas_record_csv) {
+    /* CSV only has select and reset, other switches are not kept. */
+    for (i = 0; i < 5; i++) {
+      line[i * 2]      = ((frame[0] >> i) & 1) ? '1' : '0';
+      line[10 + i * 2] = ((frame[1] >> i) & 1) ? '1' : '0';
+    }
+    line[20] = (system_switches & 0x2) ? '0' : '1';
+    line[22] = (system_switches & 0x1) ? '0' : '1';
+    for (i = 1; i < TAS_CSV_LINE_SIZE; i += 2) {
+      line[i] = ',';
+    }
+    line[TAS_CSV_LINE_SIZE] = '\n';
+    tas_record_put(line, sizeof(line));
+    return;
+  }
+
+  if (tas_record_run > 0 && tas_record_run < TAS_RECORD_RUN_MAX &&
+      memcmp(frame, tas_record_last, sizeof(frame)) == 0) {
+    tas_record_run++;
+    return;
+  }
+
+  tas_record_flush_run();
+  memcpy(tas_record_last, frame, sizeof(frame));
+  tas_record_run = 1;
+}
+
+
+
@@ -1,6 +1,15 @@
 #ifndef _TAS_H
 #define _TAS_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TAS_PLAYER_UP    0x01
+#define TAS_PLAYER_DOWN  0x02
+#define TAS_PLAYER_LEFT  0x04
+#define TAS_PLAYER_RIGHT 0x08
+#define TAS_PLAYER_FIRE  0x10
+
 int tas_init(const char *filename);
 uint8_t tas_get_system_switches(void);
 uint8_t tas_get_joystick_movement(void);
@@ -8,5 +17,10 @@ bool tas_get_joystick_button_p0(void);
 bool tas_get_joystick_button_p1(void);
 void tas_update(void);
 bool tas_is_active(void);
+void tas_set(uint8_t system_switches, uint8_t joystick_movement,
+  bool joystick_button_p0, bool joystick_button_p1);
+int tas_record_init(const char *filename);
+void tas_record(uint8_t system_switches, uint8_t joystick_movement,
+  bool joystick_button_p0, bool joystick_button_p1);
 
 #endif /* _TAS_H */
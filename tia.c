@@ -8,16 +8,14 @@
 #include "mem.h"
 #include "gui.h"
 #include "console.h"
-#include "tas.h"
+#include "input.h"
 #include "audio.h"
 #include "main.h"
 
 #define TIA_DOT_VISIBLE 68
-#define TIA_DOT_MAX 228
 
 #define TIA_SCANLINE_VISIBLE_START 27
 #define TIA_SCANLINE_VISIBLE_END 254
-#define TIA_SCANLINE_MAX 262
 
 
 
@@ -143,10 +141,32 @@ static uint8_t tia_color(uint8_t value)
 
 
 
-static uint8_t tia_read_hook(void *tia, uint16_t address)
+static void tia_input_update(tia_t *tia)
+{
+  tia->input[4].state = input_get_joystick_button_p0();
+  tia->input[5].state = input_get_joystick_button_p1();
+}
+
+
+
+static bool tia_input_state(tia_t *tia, int input)
+{
+  /* Same as tia_input_update() would give, without changing anything. */
+  switch (input) {
+  case 4:
+    return input_get_joystick_button_p0();
+  case 5:
+    return input_get_joystick_button_p1();
+  default:
+    return tia->input[input].state;
+  }
+}
+
+
+
+static uint8_t tia_peek_hook(void *tia, uint16_t address)
 {
   address &= 0xF; /* Mirroring */
-  sync(); /* Sync CPU and TIA. */
 
   /* Set the lower unused bits of the collision registers to the address.
      This handles bugs in games that used e.g. '$13' instead of '#$13'. */
@@ -196,7 +216,7 @@ static uint8_t tia_read_hook(void *tia, uint16_t address)
   case TIA_INPT3:
   case TIA_INPT4:
   case TIA_INPT5:
-    return ((tia_t *)tia)->input[address - 8].state ? 0x80 : 0x00;
+    return tia_input_state(tia, address - 8) ? 0x80 : 0x00;
 
   default:
     return 0;
@@ -205,6 +225,15 @@ static uint8_t tia_read_hook(void *tia, uint16_t address)
 
 
 
+static uint8_t tia_read_hook(void *tia, uint16_t address)
+{
+  sync(); /* Sync CPU and TIA. */
+  tia_input_update(tia);
+  return tia_peek_hook(tia, address);
+}
+
+
+
 static void tia_collision_clear(tia_t *tia)
 {
   int i;
@@ -339,27 +368,39 @@ static void tia_write_hook(void *tia, uint16_t address, uint8_t value)
     break;
 
   case TIA_AUDC0:
-    audio_set_control(0, value & 0xF);
+    if (((tia_t *)tia)->audio) {
+      audio_set_control(0, value & 0xF);
+    }
     break;
 
   case TIA_AUDC1:
-    audio_set_control(1, value & 0xF);
+    if (((tia_t *)tia)->audio) {
+      audio_set_control(1, value & 0xF);
+    }
     break;
 
   case TIA_AUDF0:
-    audio_set_frequency(0, value & 0x1F);
+    if (((tia_t *)tia)->audio) {
+      audio_set_frequency(0, value & 0x1F);
+    }
     break;
 
   case TIA_AUDF1:
-    audio_set_frequency(1, value & 0x1F);
+    if (((tia_t *)tia)->audio) {
+      audio_set_frequency(1, value & 0x1F);
+    }
     break;
 
   case TIA_AUDV0:
-    audio_set_volume(0, value & 0xF);
+    if (((tia_t *)tia)->audio) {
+      audio_set_volume(0, value & 0xF);
+    }
     break;
 
   case TIA_AUDV1:
-    audio_set_volume(1, value & 0xF);
+    if (((tia_t *)tia)->audio) {
+      audio_set_volume(1, value & 0xF);
+    }
     break;
 
   case TIA_GRP0:
@@ -484,6 +525,10 @@ void tia_init(tia_t *tia, mem_t *mem)
   mem->tia = tia;
   mem->tia_read  = tia_read_hook;
   mem->tia_write = tia_write_hook;
+  mem->tia_peek  = tia_peek_hook;
+
+  tia->render = true;
+  tia->audio = true;
 
   tia->dot = 0;
   tia->scanline = 0;
@@ -855,7 +900,7 @@ void tia_execute(tia_t *tia)
     tia->dot = 0;
     tia->rdy = true;
 
-    if (visible_scanline) {
+    if (visible_scanline && tia->render) {
       gui_draw_scanline(tia->scanline - TIA_SCANLINE_VISIBLE_START,
         tia->scanline_colors);
       console_draw_scanline(tia->scanline - TIA_SCANLINE_VISIBLE_START,
@@ -873,16 +918,14 @@ void tia_execute(tia_t *tia)
       tia_draw_dot(tia);
     }
   }
+}
 
-  if (tas_is_active()) {
-    tia->input[4].state = tas_get_joystick_button_p0();
-    tia->input[5].state = tas_get_joystick_button_p1();
-  } else {
-    tia->input[4].state = gui_get_joystick_button_p0() &
-                          console_get_joystick_button_p0();
-    tia->input[5].state = gui_get_joystick_button_p1() &
-                          console_get_joystick_button_p1();
-  }
+
+
+int tia_rdy_cycles(tia_t *tia)
+{
+  /* CPU cycles of 3 dots each until the end of the scanline releases RDY. */
+  return (TIA_DOT_MAX - tia->dot + 2) / 3;
 }
 
 
@@ -895,6 +938,7 @@ void tia_dump(FILE *fh, tia_t *tia)
     {"M0-P1", "M0-P0", "M1-P0", "M1-P1", "P0-PF", "P0-BL", "P1-PF", "P1-BL",
      "M0-PF", "M0-BL", "M1-PF", "M1-BL", "BL-PF", "P0-P1", "M0-M1"};
 
+  tia_input_update(tia);
   fprintf(fh, "Scanline/Dot: %d/%d\n", tia->scanline, tia->dot);
   fprintf(fh, "RDY   : %d (%s)\n", tia->rdy, tia->rdy ? "Run" : "Halt");
   fprintf(fh, "VSYNC : %d (Done: %d)\n", tia->vsync, tia->vsync_done);
@@ -7,6 +7,8 @@
 #include "mem.h"
 
 #define TIA_SCANLINE_WIDTH 160
+#define TIA_DOT_MAX 228
+#define TIA_SCANLINE_MAX 262
 #define TIA_INPUTS 6
 
 typedef enum {
@@ -60,6 +62,8 @@ typedef struct tia_input_data_s {
 } tia_input_data_t;
 
 typedef struct tia_s {
+  bool render; /* Output scanlines, off when running ahead. */
+  bool audio; /* Output audio, off when running ahead. */
   uint8_t dot;
   uint16_t scanline;
   bool rdy;
@@ -144,6 +148,7 @@ typedef struct tia_s {
 
 void tia_init(tia_t *tia, mem_t *mem);
 void tia_execute(tia_t *tia);
+int tia_rdy_cycles(tia_t *tia);
 void tia_dump(FILE *fh, tia_t *tia);
 
 #endif /* _TIA_H */
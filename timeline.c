@@ -0,0 +1,363 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "timeline.h"
+#include "mos6507.h"
+#include "mem.h"
+#include "tia.h"
+#include "pia.h"
+#include "main.h"
+
+
+
+#define TIMELINE_CPU_MHZ 1.193182 /* NTSC */
+
+#define TIMELINE_WRITE 0x1
+#define TIMELINE_PIA   0x2
+
+#define TIMELINE_TID_FRAMES 0
+#define TIMELINE_TID_TIA_WRITE 0x10 /* + Register */
+#define TIMELINE_TID_TIA_READ 0x50
+#define TIMELINE_TID_PIA_WRITE 0x60
+#define TIMELINE_TID_PIA_READ 0x68
+#define TIMELINE_TIDS 0x70
+
+typedef struct timeline_record_s {
+  uint64_t cycle;
+  uint32_t frame;
+  uint16_t scanline;
+  uint16_t pc;
+  uint16_t address;
+  uint8_t dot;
+  uint8_t value;
+  uint8_t flags;
+} timeline_record_t;
+
+
+
+static const char *timeline_tia_write_name[0x40] = {
+  "VSYNC",  "VBLANK", "WSYNC",  "RSYNC",  "NUSIZ0", "NUSIZ1", "COLUP0",
+  "COLUP1", "COLUPF", "COLUBK", "CTRLPF", "REFP0",  "REFP1",  "PF0",
+  "PF1",    "PF2",    "RESP0",  "RESP1",  "RESM0",  "RESM1",  "RESBL",
+  "AUDC0",  "AUDC1",  "AUDF0",  "AUDF1",  "AUDV0",  "AUDV1",  "GRP0",
+  "GRP1",   "ENAM0",  "ENAM1",  "ENABL",  "HMP0",   "HMP1",   "HMM0",
+  "HMM1",   "HMBL",   "VDELP0", "VDELP1", "VDELBL", "RESMP0", "RESMP1",
+  "HMOVE",  "HMCLR",  "CXCLR",
+};
+
+static const char *timeline_tia_read_name[0x10] = {
+  "CXM0P",  "CXM1P",  "CXP0FB", "CXP1FB", "CXM0FB", "CXM1FB", "CXBLPF",
+  "CXPPMM", "INPT0",  "INPT1",  "INPT2",  "INPT3",  "INPT4",  "INPT5",
+};
+
+static const char *timeline_pia_write_name[8] = {
+  "SWCHA", "SWACNT", "SWCHB", "SWBCNT", "TIM1T", "TIM8T", "TIM64T", "T1024T",
+};
+
+static const char *timeline_pia_read_name[8] = {
+  "SWCHA", "SWACNT", "SWCHB", "SWBCNT", "INTIM", "INSTAT", "INTIM", "INSTAT",
+};
+
+/* Every TIA and PIA register access goes into a ring allocated up front,
+   through wrappers around the memory hooks. Nothing else is done while
+   running, the Chrome trace JSON is only written out on exit. */
+static FILE *timeline_fh = NULL;
+static timeline_record_t *timeline_ring = NULL;
+static uint32_t timeline_depth;
+static uint32_t timeline_next;
+static uint64_t timeline_count;
+static uint64_t timeline_cycle_last = 0;
+
+static mos6507_t *timeline_cpu;
+static tia_t *timeline_tia;
+static pia_t *timeline_pia;
+static mem_read_hook_t  timeline_tia_read;
+static mem_write_hook_t timeline_tia_write;
+static mem_read_hook_t  timeline_pia_read;
+static mem_write_hook_t timeline_pia_write;
+
+static uint16_t timeline_pc = 0;
+static uint32_t timeline_frame_no = 0;
+static bool timeline_suspended = false;
+
+
+
+static void timeline_add(uint16_t address, uint8_t value, uint8_t flags)
+{
+  timeline_record_t *record;
+  uint64_t cycle;
+  int dot;
+
+  if (timeline_suspended) {
+    return;
+  }
+
+  /* After reverse stepping, skip what is already recorded. */
+  cycle = timeline_pia->clock + timeline_cpu->cycles;
+  if (cycle < timeline_cycle_last) {
+    return;
+  }
+  timeline_cycle_last = cycle;
+
+  /* The TIA is only synced on its own accesses, so for the PIA work out
+     where the beam is from the cycles run since then. */
+  dot = timeline_tia->dot + (timeline_cpu->cycles * 3);
+
+  record = &timeline_ring[timeline_next];
+  record->cycle    = cycle;
+  record->frame    = timeline_frame_no;
+  record->scanline = (timeline_tia->scanline + (dot / TIA_DOT_MAX)) %
+                     TIA_SCANLINE_MAX;
+  record->dot      = dot % TIA_DOT_MAX;
+  record->pc       = timeline_pc;
+  record->address  = address;
+  record->value    = value;
+  record->flags    = flags;
+
+  timeline_next++;
+  if (timeline_next >= timeline_depth) {
+    timeline_next = 0;
+  }
+  timeline_count++;
+}
+
+
+
+static uint8_t timeline_tia_read_hook(void *tia, uint16_t address)
+{
+  uint8_t value;
+
+  sync(); /* As the TIA does first, so the beam position is exact. */
+  value = (timeline_tia_read)(tia, address);
+  timeline_add(address & 0x0F, value, 0);
+  return value;
+}
+
+
+
+static void timeline_tia_write_hook(void *tia, uint16_t address,
+  uint8_t value)
+{
+  sync();
+  timeline_add(address & 0x3F, value, TIMELINE_WRITE);
+  (timeline_tia_write)(tia, address, value);
+}
+
+
+
+static uint8_t timeline_pia_read_hook(void *pia, uint16_t address)
+{
+  uint8_t value;
+
+  value = (timeline_pia_read)(pia, address);
+  if ((address & 0x200) > 0) { /* I/O, RAM is not recorded. */
+    timeline_add(address & 0x287, value, TIMELINE_PIA);
+  }
+  return value;
+}
+
+
+
+static void timeline_pia_write_hook(void *pia, uint16_t address,
+  uint8_t value)
+{
+  if ((address & 0x200) > 0) {
+    timeline_add(address & 0x287, value, TIMELINE_PIA | TIMELINE_WRITE);
+  }
+  (timeline_pia_write)(pia, address, value);
+}
+
+
+
+static int timeline_tid(const timeline_record_t *record)
+{
+  if (record->flags & TIMELINE_PIA) {
+    return ((record->flags & TIMELINE_WRITE) ? TIMELINE_TID_PIA_WRITE :
+      TIMELINE_TID_PIA_READ) + (record->address & 7);
+  } else if (record->flags & TIMELINE_WRITE) {
+    return TIMELINE_TID_TIA_WRITE + record->address;
+  } else {
+    return TIMELINE_TID_TIA_READ + record->address;
+  }
+}
+
+
+
+static const char *timeline_name(int tid)
+{
+  const char *name = NULL;
+
+  if (tid >= TIMELINE_TID_PIA_READ) {
+    name = timeline_pia_read_name[tid - TIMELINE_TID_PIA_READ];
+  } else if (tid >= TIMELINE_TID_PIA_WRITE) {
+    name = timeline_pia_write_name[tid - TIMELINE_TID_PIA_WRITE];
+  } else if (tid >= TIMELINE_TID_TIA_READ) {
+    name = timeline_tia_read_name[tid - TIMELINE_TID_TIA_READ];
+  } else if (tid >= TIMELINE_TID_TIA_WRITE) {
+    name = timeline_tia_write_name[tid - TIMELINE_TID_TIA_WRITE];
+  }
+  return (name != NULL) ? name : "Unused";
+}
+
+
+
+static void timeline_frame_write(uint32_t frame, double start, double end)
+{
+  fprintf(timeline_fh, "{\"name\":\"Frame %u\",\"cat\":\"Frame\","
+    "\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f},\n",
+    frame, TIMELINE_TID_FRAMES, start, end - start);
+}
+
+
+
+static void timeline_write(void)
+{
+  timeline_record_t *record;
+  bool used[TIMELINE_TIDS];
+  uint32_t i, n, start;
+  uint32_t frame = 0;
+  double ts, frame_ts = 0.0;
+  int tid;
+
+  memset(used, 0, sizeof(used));
+  n = (timeline_count < timeline_depth) ? timeline_count : timeline_depth;
+  start = (timeline_count < timeline_depth) ? 0 : timeline_next;
+
+  fprintf(timeline_fh, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+  /* One track per register, in the order the TIA and PIA decode them,
+     with a span for each frame on a track above. */
+  ts = 0.0;
+  for (i = 0; i < n; i++) {
+    record = &timeline_ring[(start + i) % timeline_depth];
+    tid = timeline_tid(record);
+    used[tid] = true;
+    ts = record->cycle / TIMELINE_CPU_MHZ;
+
+    if (i == 0) {
+      frame = record->frame;
+      frame_ts = ts;
+    } else if (record->frame != frame) {
+      timeline_frame_write(frame, frame_ts, ts);
+      frame = record->frame;
+      frame_ts = ts;
+    }
+
+    fprintf(timeline_fh, "{\"name\":\"%s\",\"cat\":\"%s %s\",\"ph\":\"i\","
+      "\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"args\":{"
+      "\"value\":\"$%02x\",\"frame\":%u,\"scanline\":%u,\"dot\":%u,"
+      "\"cycle\":%llu,\"pc\":\"$%04x\"}},\n",
+      timeline_name(tid),
+      (record->flags & TIMELINE_PIA) ? "PIA" : "TIA",
+      (record->flags & TIMELINE_WRITE) ? "write" : "read",
+      tid, ts, record->value, record->frame, record->scanline, record->dot,
+      (unsigned long long)record->cycle, record->pc);
+  }
+  if (n > 0) {
+    timeline_frame_write(frame, frame_ts, ts);
+  }
+
+  fprintf(timeline_fh, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+    "\"args\":{\"name\":\"Atari 2600\"}},\n");
+  fprintf(timeline_fh, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+    "\"tid\":%d,\"args\":{\"name\":\"Frames\"}}", TIMELINE_TID_FRAMES);
+  for (tid = 0; tid < TIMELINE_TIDS; tid++) {
+    if (! used[tid]) {
+      continue;
+    }
+    fprintf(timeline_fh, ",\n{\"name\":\"thread_name\",\"ph\":\"M\","
+      "\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %s%s\"}}",
+      tid, (tid >= TIMELINE_TID_PIA_WRITE) ? "PIA" : "TIA",
+      timeline_name(tid),
+      (tid >= TIMELINE_TID_PIA_READ ||
+      (tid >= TIMELINE_TID_TIA_READ && tid < TIMELINE_TID_PIA_WRITE)) ?
+      " (read)" : "");
+    fprintf(timeline_fh, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\","
+      "\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}", tid, tid);
+  }
+  fprintf(timeline_fh, "\n]}\n");
+}
+
+
+
+static void timeline_exit(void)
+{
+  if (timeline_fh == NULL) {
+    return;
+  }
+
+  timeline_write();
+  fclose(timeline_fh);
+  timeline_fh = NULL;
+  free(timeline_ring);
+  timeline_ring = NULL;
+}
+
+
+
+int timeline_init(const char *filename, uint32_t depth, mos6507_t *cpu,
+  mem_t *mem)
+{
+  /* Must be called after the TIA and PIA have installed their hooks. */
+  if (depth == 0) {
+    depth = TIMELINE_DEPTH_DEFAULT;
+  }
+  timeline_ring = malloc(depth * sizeof(timeline_record_t));
+  if (timeline_ring == NULL) {
+    return -1;
+  }
+
+  timeline_fh = fopen(filename, "w");
+  if (timeline_fh == NULL) {
+    free(timeline_ring);
+    timeline_ring = NULL;
+    return -1;
+  }
+
+  timeline_depth = depth;
+  timeline_next = 0;
+  timeline_count = 0;
+
+  timeline_cpu = cpu;
+  timeline_tia = (tia_t *)mem->tia;
+  timeline_pia = (pia_t *)mem->pia;
+  timeline_tia_read  = mem->tia_read;
+  timeline_tia_write = mem->tia_write;
+  timeline_pia_read  = mem->pia_read;
+  timeline_pia_write = mem->pia_write;
+  mem->tia_read  = timeline_tia_read_hook;
+  mem->tia_write = timeline_tia_write_hook;
+  mem->pia_read  = timeline_pia_read_hook;
+  mem->pia_write = timeline_pia_write_hook;
+
+  atexit(timeline_exit);
+  return 0;
+}
+
+
+
+void timeline_instruction(uint16_t pc)
+{
+  timeline_pc = pc;
+}
+
+
+
+void timeline_frame(uint32_t frame)
+{
+  timeline_frame_no = frame;
+}
+
+
+
+void timeline_suspend(bool suspend)
+{
+  /* Used while running ahead or replaying, which is not the real timeline. */
+  timeline_suspended = suspend;
+}
+
+
+
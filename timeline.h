@@ -0,0 +1,17 @@
+#ifndef _TIMELINE_H
+#define _TIMELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mos6507.h"
+#include "mem.h"
+
+#define TIMELINE_DEPTH_DEFAULT 0x40000
+
+int timeline_init(const char *filename, uint32_t depth, mos6507_t *cpu,
+  mem_t *mem);
+void timeline_instruction(uint16_t pc);
+void timeline_frame(uint32_t frame);
+void timeline_suspend(bool suspend);
+
+#endif /* _TIMELINE_H */
@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mos6507.h"
+#include "mos6507_disasm.h"
+#include "mos6507_trace.h"
+
+
+
+/* Decodes a binary trace file written with "atarascii -T" to text, in the
+   same format as the CPU trace in the debugger. */
+
+
+
+static uint16_t trace_get16(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+
+
+static uint32_t trace_get32(const uint8_t *p)
+{
+  return trace_get16(&p[0]) | ((uint32_t)trace_get16(&p[2]) << 16);
+}
+
+
+
+static uint64_t trace_get64(const uint8_t *p)
+{
+  return trace_get32(&p[0]) | ((uint64_t)trace_get32(&p[4]) << 32);
+}
+
+
+
+static void trace_decode(FILE *fh, const uint8_t *record)
+{
+  mos6507_t cpu;
+  uint8_t mc[3];
+  uint8_t sr;
+
+  memset(&cpu, 0, sizeof(mos6507_t));
+  cpu.pc = trace_get16(&record[MOS6507_TRACE_RECORD_PC]);
+  cpu.a  = record[MOS6507_TRACE_RECORD_A];
+  cpu.x  = record[MOS6507_TRACE_RECORD_X];
+  cpu.y  = record[MOS6507_TRACE_RECORD_Y];
+  cpu.sp = record[MOS6507_TRACE_RECORD_SP];
+  sr = record[MOS6507_TRACE_RECORD_SR];
+  cpu.sr.n = sr >> 7;
+  cpu.sr.v = sr >> 6;
+  cpu.sr.b = sr >> 4;
+  cpu.sr.d = sr >> 3;
+  cpu.sr.i = sr >> 2;
+  cpu.sr.z = sr >> 1;
+  cpu.sr.c = sr;
+  memcpy(mc, &record[MOS6507_TRACE_RECORD_MC], 3);
+
+  fprintf(fh, "%06u %03u/%03u %011llu %d:%d:%d:%d  ",
+    trace_get32(&record[MOS6507_TRACE_RECORD_FRAME]),
+    trace_get16(&record[MOS6507_TRACE_RECORD_SCANLINE]),
+    record[MOS6507_TRACE_RECORD_DOT],
+    (unsigned long long)trace_get64(&record[MOS6507_TRACE_RECORD_CYCLE]),
+    record[MOS6507_TRACE_RECORD_BANK],
+    record[MOS6507_TRACE_RECORD_BANK + 1],
+    record[MOS6507_TRACE_RECORD_BANK + 2],
+    record[MOS6507_TRACE_RECORD_BANK + 3]);
+  mos6507_register_dump(fh, &cpu, mc);
+}
+
+
+
+int main(int argc, char *argv[])
+{
+  int fd;
+  struct stat st;
+  const uint8_t *data;
+  uint32_t depth;
+  uint64_t count, first, last, i, slot;
+
+  if (argc < 2) {
+    fprintf(stdout, "Usage: %s <trace file> [last instructions]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  fd = open(argv[1], O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "Unable to open trace file: %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size < MOS6507_TRACE_HEADER_SIZE) {
+    fprintf(stderr, "Invalid trace file: %s\n", argv[1]);
+    close(fd);
+    return EXIT_FAILURE;
+  }
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "Unable to map trace file: %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  if (memcmp(data, MOS6507_TRACE_MAGIC, MOS6507_TRACE_MAGIC_SIZE) != 0 ||
+    data[MOS6507_TRACE_MAGIC_SIZE] != MOS6507_TRACE_VERSION) {
+    fprintf(stderr, "Invalid trace file: %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  depth = trace_get32(&data[MOS6507_TRACE_HEADER_DEPTH]);
+  count = trace_get64(&data[MOS6507_TRACE_HEADER_COUNT]);
+
+  /* Only the last "depth" instructions are left in a ring. */
+  first = 0;
+  if (depth > 0 && count > depth) {
+    first = count - depth;
+  }
+  if (argc > 2) {
+    last = strtoull(argv[2], NULL, 0);
+    if (last < count - first) {
+      first = count - last;
+    }
+  }
+
+  for (i = first; i < count; i++) {
+    slot = (depth > 0) ? (i % depth) : i;
+    if (MOS6507_TRACE_HEADER_SIZE + ((slot + 1) * MOS6507_TRACE_RECORD_SIZE)
+      > (uint64_t)st.st_size) {
+      fprintf(stderr, "Trace file is truncated!\n");
+      return EXIT_FAILURE;
+    }
+    trace_decode(stdout, &data[MOS6507_TRACE_HEADER_SIZE +
+      (slot * MOS6507_TRACE_RECORD_SIZE)]);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+
+
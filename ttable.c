@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+
+#include "ttable.h"
+
+
+
+/* Open addressing with linear probing over 64-bit keys. The table is a
+   shared mapping, so forked processes see each other's entries, and slots
+   are claimed with compare-and-swap instead of a lock. Zero marks a free
+   slot. Entries are never removed. */
+#define TTABLE_PROBE_MAX 32
+
+
+
+static uint64_t *ttable_slot = NULL;
+static size_t ttable_size = 0;
+
+
+
+int ttable_init(int bits)
+{
+  if (bits < 1 || bits > 32) {
+    return -1;
+  }
+
+  ttable_size = (size_t)1 << bits;
+  ttable_slot = mmap(NULL, ttable_size * sizeof(uint64_t),
+    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (ttable_slot == MAP_FAILED) {
+    ttable_slot = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+void ttable_exit(void)
+{
+  if (ttable_slot != NULL) {
+    munmap(ttable_slot, ttable_size * sizeof(uint64_t));
+    ttable_slot = NULL;
+  }
+}
+
+
+
+bool ttable_insert(uint64_t key)
+{
+  uint64_t expected;
+  size_t index;
+  int probe;
+
+  /* Returns false if the key was already present. */
+  if (ttable_slot == NULL) {
+    return true;
+  }
+  if (key == 0) {
+    key = 1;
+  }
+
+  index = key & (ttable_size - 1);
+  for (probe = 0; probe < TTABLE_PROBE_MAX; probe++) {
+    expected = __atomic_load_n(&ttable_slot[index], __ATOMIC_ACQUIRE);
+    if (expected == 0) {
+      if (__atomic_compare_exchange_n(&ttable_slot[index], &expected, key,
+        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return true;
+      }
+      /* Lost the race, expected now holds the winner's key. */
+    }
+    if (expected == key) {
+      return false;
+    }
+    index = (index + 1) & (ttable_size - 1);
+  }
+
+  return true; /* Crowded, treat as new rather than risk a false match. */
+}
+
+
+
@@ -0,0 +1,13 @@
+#ifndef _TTABLE_H
+#define _TTABLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TTABLE_BITS_DEFAULT 20
+
+int ttable_init(int bits);
+void ttable_exit(void);
+bool ttable_insert(uint64_t key);
+
+#endif /* _TTABLE_H */